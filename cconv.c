@@ -4,6 +4,8 @@
  *	Stream of character strings packed into binary data according to
  *	input specification, then converted back to strings according to
  *	output specification
+ *	This is the command line front end; the conversions themselves
+ *	are in libcconv (libcconv.h, libcconv.c).
  *
  *	Output				Input
  *	-i	integer (default)	-I	integer
@@ -20,8 +22,9 @@
  *	-o	octal			-O	octal
  *	-d	decimal			-D	decimal
  *	-x	hexadecimal		-X	hexadecimal
- *	-u	unsigned/UTC		-U	unsigned (no-op)/UTC
- *	-r	raw binary		-R	raw binary
+ *	-u	unsigned/UTC		-U	unsigned (with -R)/UTC
+ *	-r	raw binary		-R	raw binary, of output type
+ *					unless its type is given
  *	-y	date			-Y	date
  *
  *	type:	.bc..fghij.l...p..s.....y.
@@ -33,56 +36,88 @@
  * (	-q	quote strings		-Q	allow quoted strings
  * (	-t	Tcl quoting		-T	allow Tcl quoting
  *	-e	byte-swap		-E	byte-swap
- *	-m	multiple per line	-M	multiple per line
+ *	-m N	N values per line	-M	multiple per line
  *	-N	read from named file
+ *	--sep=STR	separator between output values
+ *	--width=N	zero-pad integers to N digits
+ *	--shortest	float/double as shortest text that reads back exactly
+ *	--precision=N	float/double to N significant digits
+ *	--jobs=N	convert raw file in N parallel threads
+ *	--epoch=UNIT	binary dates as s, ms, us, ns or double seconds
+ *	--record=LAYOUT	binary records, e.g. '<ihhhd', one per line as text
+ *	--skip=BYTES	pass over the first BYTES of the file (-N)
+ *	--stride=K	every K-th value only
+ *	--channel=C/NCH	value C (from 0) of every NCH, e.g. one channel of
+ *			interleaved data
+ *	--count=N	at most N values
+ *	--scale=A,...	calibrate: value times A plus B, from lists per channel
+ *	--offset=B,...	of interleaved values, as the output type
+ *	--wrap		from raw: integers keep low bits instead of saturating
+ *	--truncate	from raw: floats to integers toward zero, not nearest
+ *	--decimate=N	min and max of every N values, e.g. for plotting
+ *	--points=M	as --decimate, to at most M buckets of a raw file
+ *	--mean		with --decimate or --points, the mean as well
+ *	--aggregate	count, min, max, sum, mean and stddev instead of values
+ *	--histogram=N,LO,HI  as --aggregate, with counts in N bins over
+ *			[LO, HI)
+ *	--stats[=json]	counts and times per stage on stderr, as a table or JSON
+ *	--serve[=SOCKET] answer requests of options and values, one per
+ *			line, on stdin/stdout or a Unix-domain socket
  *=======================================================================*/
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
-#include <stdint.h>
 #include <string.h>
-#include <memory.h>
-#ifdef __sunos5__
-# define HAVE_NORDFLOAT 1
-# define HAVE_POINT 1
-# define HAVE_BCN 1
-#endif
 #include <ctype.h>
-#include <limits.h>
 #include <errno.h>
-#include <time.h>
-
-#if HAVE_NORDFLOAT
-# include <csl3.h>			/* cf32to48_ etc. */
-#endif
-#if HAVE_POINT
-# include <cddefs.h>
-# include <csl9.h>
-#endif
-/* Avoid need to call csl4 functions */
-#define cmgbcn(bcn,b,c,n) (*(b) = (bcn)>>11, *(c)=((bcn)>>5)&63, *(n)=(bcn)&31)
-#define cmdbcn(bcn,b,c,n) (*(bcn) = (((b)&15)<<11) | (((c)&63)<<5) | ((n)&31))
-
-#ifdef __sunos5__
-/*--- Ancient gcc, lacks builtins */
-static uint16_t bswap16(uint16_t x);
-static uint32_t bswap32(uint32_t x);
-static uint64_t bswap64(uint64_t x);
-#else
-#define bswap16 __builtin_bswap16
-#define bswap32 __builtin_bswap32
-#define bswap64 __builtin_bswap64
-#endif
-
-const char usage[] = "Usage: %s [-chilfdsbjpryuzodx] [-CHILFDSBJPRYUZODX] value... | -N filename\n\
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "libcconv.h"
+
+const char usage[] = "Usage: %s [-chilfdsbjpryuzodx] [-CHILFDSBJPRYUZODX] [-m N] [-M] value... | -N filename\n\
   lower case option = convert to,  upper case = convert from\n\
   types:\n\
     i=integer   l=long      h=short     c=char      f=float     d=double\n\
-    s=string    b=BCN       p=pointname j=Nordfloat y=date      r=raw\n\
+    s=string    b=BCN       p=pointname j=Nordfloat y=date\n\
   modifiers:\n\
-    u=unsigned  e=byteswap\n\
+    u=unsigned  e=byteswap  r=raw binary of given type\n\
+                R alone is raw of the output type, copied as it is;\n\
+                with a type, e.g. -HR -f, converted to the output type\n\
+    m N=N values per output line   M=split input lines into values\n\
+                at spaces, tabs or commas; an empty field between\n\
+                commas, as in 5,,6, is an error\n\
   styles:\n\
     z=binary    o=octal     d=decimal   x=hex\n\
+  long options:\n\
+    --sep=STR   separator between output values (default newline)\n\
+    --width=N   zero-pad integers to at least N digits\n\
+    --shortest  shortest float/double text that reads back exactly\n\
+    --precision=N  float/double to N significant digits\n\
+    --jobs=N    convert a raw file (-N -R) with N threads\n\
+    --record=L  binary records of struct-style layout L, e.g. '<ihhhd'\n\
+    --epoch=U   binary dates in U = s (time_t), ms, us, ns (int64)\n\
+                or double (seconds); sub-second dates print as ISO-8601\n\
+    --skip=BYTES  with -N, pass over BYTES at the start of the file\n\
+    --stride=K  every K-th value    --channel=C/NCH  value C of every NCH\n\
+    --count=N   at most N values (after --stride or --channel)\n\
+    --scale=A[,A...]  --offset=B[,B...]  output values x*A+B, with A and B\n\
+                per channel of interleaved data if more than one\n\
+    --wrap      raw to other integer type: keep low bits, not saturate\n\
+    --truncate  raw float to integer: toward zero, not to nearest\n\
+    --decimate=N  min and max of every N values, as the output type,\n\
+                a line each; with --mean, and their mean\n\
+    --points=M  as --decimate, to at most M lines from a raw file\n\
+    --aggregate  only count, min, max, sum, mean and stddev of values\n\
+    --histogram=N,LO,HI  --aggregate, and counts in N bins from LO to HI\n\
+    --stats[=json]  counts and times per conversion stage on stderr\n\
+    --serve[=SOCKET]  answer requests like \"-Hx 1234\", one per line,\n\
+                on stdin/stdout or a Unix-domain socket\n\
 ";
 
 #ifndef TRUE
@@ -90,902 +125,258 @@ const char usage[] = "Usage: %s [-chilfdsbjpryuzodx] [-CHILFDSBJPRYUZODX] value.
 #define FALSE 0
 #endif
 
-#define NEW(t) (t *)new(sizeof(t))
-
-static void *new(int);
-static void fail(const char *, ...);
-
-/*-----------------------------------------------------------------------
- *	Conversion control
- *-----------------------------------------------------------------------*/
-
-enum Type {
-  TYPE_RAW,
-  TYPE_CHAR,
-  TYPE_SHORT,
-  TYPE_INT,
-  TYPE_LONG,
-  TYPE_FLOAT,
-  TYPE_DOUBLE,
-  TYPE_STRING,
-#if HAVE_POINT
-  TYPE_POINT,
-#endif
-#if HAVE_BCN
-  TYPE_BCN,
-#endif
-#if HAVE_NORDFLOAT
-  TYPE_NORDFLOAT,
-#endif
-  TYPE_DATE
-};
-
-enum Style {
-  STYLE_DEFAULT,
-  STYLE_BINARY,
-  STYLE_OCTAL,
-  STYLE_DECIMAL,
-  STYLE_HEX
-};
-
-enum Quoting {
-  QUOTING_NONE,
-  QUOTING_SHELL,
-  QUOTING_TCL
-};
-
-typedef struct {
-  enum Type type;
-  enum Style style;
-  enum Quoting quoting;
-  int unsignedp;			/* Also UTC for date */
-  int byteswap;
-} Conversion;
-
-static Conversion *conversion_create(void)
-{
-  Conversion *this = NEW(Conversion);
-  this->type = TYPE_INT;
-  this->style = STYLE_DEFAULT;
-  this->quoting = QUOTING_NONE;
-  this->unsignedp = FALSE;
-  this->byteswap = FALSE;
-  return this;
-}
-
-typedef union {
-  char cval;
-  short sval;
-  int ival;
-  long lval;				/* 32-bit or 64-bit per architecture */
-  float fval;
-  double dval;
-  time_t time;
-#if HAVE_POINT
-  pknam_t pknam;
-#endif
-#if HAVE_NORDFLOAT
-  short nf[3];
+#ifdef __sunos5__
+# define THREAD_LOCAL			/* Ancient gcc */
+#else
+# define THREAD_LOCAL __thread
 #endif
-  uint32_t u32;
-  uint64_t u64;
-  char bytes[8];
-} Uscalar;
-
-/*=======================================================================
- *	Data producer stream
- *	Returns pointer to data, and size (may be what asked for, or not).
- *	Returns -1 when end reached.
- *=======================================================================*/
-typedef int(*Producer)(void *, char **, int);
-
-static char *progname;
 
 /*-----------------------------------------------------------------------
- *	Raw data producer from file
+ *	Report a problem with the options: on stderr, or as the first
+ *	message in msg if given (for --serve)
  *-----------------------------------------------------------------------*/
-typedef struct {
-  const char *filename;
-  FILE *f;
-  int eof;
-} FileStream;
+#define MSG_SIZE 256
 
-static void *file_create(const char *filename)
+static void complain(char *msg, const char *fmt, ...)
 {
-  FileStream *this = NEW(FileStream);
-  this->filename = strcpy(new(strlen(filename)+1), filename);
-  if (strcmp(filename, "-") == 0) {
-    this->f = stdin;
-  } else {
-    this->f = fopen(filename, "rb");
-    if (this->f == NULL) {
-      fail("Cannot open %s for read", filename);
-    }
-  }
-  this->eof = FALSE;
-  return this;
-}
-
-static int file_get(void *closure, char **data, int size)
-{
-  FileStream *this = closure;
-  char *buf;
-  int nread;
-  if (this->eof) return -1;
-  buf = new(size);
-  if (fgets(buf, size, this->f) == NULL) {
-    this->eof = TRUE;
-    free(buf);
-    return -1;
-  } else {
-    nread = strlen(buf);
-    *data = realloc(buf, nread+1);
-    return nread;
-  }
-}
-
-static int file_get_raw(void *closure, char **data, int size)
-{
-  FileStream *this = closure;
-  char *buf;
-  int nread;
-  if (this->eof) return -1;
-  buf = new(size);
-  nread = fread(buf, 1, size, this->f);
-  if (nread <= 0) {
-    this->eof = TRUE;
-    free(buf);
-    return -1;
-  } else {
-    *data = buf;
-    return nread;
-  }
-}
-
-/*-----------------------------------------------------------------------
- *	String producer from argv.
- *	May return more than asked for.
- *-----------------------------------------------------------------------*/
-typedef struct {
-  int argc;
-  char **argv;
-} ArgvStream;
-
-static void *argv_create(int argc, char **argv)
-{
-  ArgvStream *this = NEW(ArgvStream);
-  this->argc = argc;
-  this->argv = argv;
-  return this;
-}
-
-static int argv_get(void *closure, char **data, int size)
-{
-  ArgvStream *this = closure;
-  if (this->argc <= 0) {
-    return -1;
+  va_list ap;
+  va_start(ap, fmt);
+  if (msg == NULL) {
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+  } else if (*msg == '\0') {
+    vsnprintf(msg, MSG_SIZE, fmt, ap);
   }
-  this->argc--;
-  *data = *(this->argv)++;
-  return strlen(*data);
-}
-
-/*-----------------------------------------------------------------------
- *	Size reducer stream
- *	Child producer may give more than we want; make sure we don't
- *	return more than wanted to caller.
- *-----------------------------------------------------------------------*/
-typedef struct {
-  Producer child;
-  void *closure;
-  char *last;
-  int size;
-  int offset;
-} Reducer;
-
-static void *reducer_create(Producer child, void *closure)
-{
-  Reducer *this = NEW(Reducer);
-  this->child = child;
-  this->closure = closure;
-  this->last = NULL;
-  this->size = 0;
-  this->offset = 0;
-  return this;
+  va_end(ap);
 }
 
-static int reducer_get(void *closure, char **data, int size)
+/*--- Value of long option, either after '=' or in the next argument */
+static char *optvalue(char *value, int *p_argc, char ***p_argv, char *msg)
 {
-  Reducer *this = closure;
-  int num;
-  while (this->offset >= this->size) {
-    if (this->size == -1) return -1;
-    this->size = this->child(this->closure, &this->last, 65536);
-    this->offset = 0;
+  if (value != NULL) return value;
+  if (*p_argc <= 1) {
+    complain(msg, "Missing value after %s", **p_argv);
+    return NULL;
   }
-  *data = this->last + this->offset;
-  num = this->size - this->offset;
-  if (num > size) num = size;
-  this->offset += num;
-  return num;
+  (*p_argc)--, (*p_argv)++;
+  return **p_argv;
 }
 
-/*-----------------------------------------------------------------------
- *	Data expander
- *	Ensure you always get as much as you ask for
- *-----------------------------------------------------------------------*/
-typedef struct {
-  Producer child;
-  void *closure;
-  char *buffer;
-  int size;
-} Expander;
-
-static void *expander_create(Producer child, void *closure)
+/*--- Interpret \n, \t, \r and \\ in place */
+static char *unescape(char *str)
 {
-  Expander *this = NEW(Expander);
-  this->child = child;
-  this->closure = closure;
-  this->buffer = new(this->size = 40);
-  return this;
-}
-
-static int expander_get(void *closure, char **data, int size)
-{
-  Expander *this = closure;
-  int done, num;
-  char *in;
-
-  num = this->child(this->closure, &in, size);
-  if (num < 0) return -1;
-  if (num < size) {
-    if (size > this->size) {
-      free(this->buffer);
-      this->buffer = new(this->size = size); /* Should realloc really */
-    }
-    memcpy(this->buffer, in, num);
-    done = num;
-    while (done < size) {
-      num = this->child(this->closure, &in, size-done);
-      if (num < 0) {
-	memset(this->buffer + done, 0, size-done);
-	done = size;
-      } else {
-	memcpy(this->buffer + done, in, num);
-	done += num;
+  char *s, *d;
+  for (s = d = str; *s; s++) {
+    if (*s == '\\' && s[1] != '\0') {
+      switch (*++s) {
+      case 'n': *d++ = '\n'; break;
+      case 't': *d++ = '\t'; break;
+      case 'r': *d++ = '\r'; break;
+      default: *d++ = *s;
       }
-    }
-    *data = this->buffer;
-    return done;
-  } else {
-    *data = in;
-    return num;
-  }
-}
-
-/*-----------------------------------------------------------------------
- *	Convert from text to long
- *	Allow either signed or unsigned
- *	N.B. strto[u]l set only only on error, so to distinguish from
- *	legitimate LONG_MAX etc., must clear errno first - see man page.
- *-----------------------------------------------------------------------*/
-static long lax_strtol(const char *text, char **rest, int base)
-{
-  long lval;
-  errno = 0;
-  lval = strtol(text, rest, base);
-  if ((lval == LONG_MAX || lval == LONG_MIN) && errno == ERANGE) {
-    /*--- Not valid signed int - try unsigned */
-    errno = 0;
-    lval = strtoul(text, rest, base);
-    if (lval == ULONG_MAX && errno == ERANGE) {
-      lval = 0;
-    }
-  }
-  return lval;
-}
-#define STRTOL lax_strtol
-
-static int amatch(const char *str, char const * const *vals, int nval)
-{
-  int i;
-  for (i=0; i<nval; i++) {
-    if (strcmp(str, vals[i]) == 0) return i;
-  }
-  return -1;
-}
-
-/*-----------------------------------------------------------------------
- *	Interpret randomly formatted date/time and convert to seconds
- *	since epoch (Jan 1 1970).
- *-----------------------------------------------------------------------*/
-static int text2date(const char *str, time_t *p_time, int utc)
-{
-  static char const * const wday[7] = {
-    "Sun","Mon","Tue","Wed","Thu","Fri","Sat"
-  };
-  static char const * const mon[12] = {
-    "Jan","Feb","Mar","Apr","May","Jun","Jul","Aug","Sep","Oct","Nov","Dec"
-  };
-  static char const * const month[12] = {
-    "January","February","March","April","May","June",
-    "July","August","Sepember","October","November","December"
-  };
-  time_t now = time(NULL);
-  struct tm date = *localtime(&now);
-  int i1, i2, i3, i4, i5, i6;
-  char *copystr, *tok, c;
-  int have_year=0, have_month=0, have_day=0, have_hour=0, have_min=0, have_sec=0, have_dst=0;
-  copystr = strcpy(malloc(strlen(str)+1), str);	/* strdup is not POSIX */
-  for (tok = strtok(copystr, " ,"); tok != NULL; tok = strtok(NULL, " ,")) {
-    int len = strlen(tok);
-    if ((i1 = amatch(tok, wday, 7)) >= 0) {
-      /* Redundant - ignore */
-    } else if ((i1 = amatch(tok, mon, 12)) >= 0) {
-      date.tm_mon = i1; have_month = TRUE;
-    } else if ((i1 = amatch(tok, month, 12)) >= 0) {
-      date.tm_mon = i1; have_month = TRUE;
-    } else if (((len == 20 &&
-		 sscanf(tok, "%4d-%2d-%2dT%2d:%2d:%2dZ%c",
-			&i1, &i2, &i3, &i4, &i5, &i6, &c) == 6) ||
-		(len == 16 &&
-		 sscanf(tok, "%4d%2d%2dT%2d%2d%2dZ%c",
-			&i1, &i2, &i3, &i4, &i5, &i6, &c) == 6)) &&
-	       i1 >= 1970 && i1 < 2038 &&
-	       i2 >= 1 && i2 < 12 &&
-	       i3 >= 1 && i3 < 31 &&
-	       i4 >= 0 && i4 < 24 &&
-	       i5 >= 0 && i5 < 60 &&
-	       i6 >= 0 && i6 < 60) {	/* Disallow leap seconds */
-      date.tm_year = i1 - 1900; have_year = TRUE;
-      date.tm_mon  = i2 - 1; have_month = TRUE;
-      date.tm_mday = i3; have_day = TRUE;
-      date.tm_hour = i4; have_hour = TRUE;
-      date.tm_min  = i5; have_min = TRUE;
-      date.tm_sec  = i6; have_sec = TRUE;
-      date.tm_isdst = 0; have_dst = TRUE;
-    } else if (len == 8 &&
-	       sscanf(tok, "%2d:%2d:%2d%c", &i1, &i2, &i3, &c) == 3 &&
-	       i1 >= 0 && i1 < 24 &&
-	       i2 >= 0 && i2 < 60 &&
-	       i3 >= 0 && i3 < 60) {	/* Disallow leap seconds */
-      date.tm_hour = i1; have_hour = TRUE;
-      date.tm_min = i2; have_min = TRUE;
-      date.tm_sec = i3; have_sec = TRUE;
-    } else if (len == 5 &&
-	       sscanf(tok, "%2d:%2d%c", &i1, &i2, &c) == 2 &&
-	       i1 >= 0 && i1 < 24 &&
-	       i2 >= 0 && i2 < 60) {
-      date.tm_hour = i1; have_hour = TRUE;
-      date.tm_min = i2; have_min = TRUE;
-    } else if (sscanf(tok, "%d%c", &i1, &c) == 1 &&
-	       i1 >= 1 && i1 <= 31) {
-      date.tm_mday = i1; have_day = TRUE;
-    } else if (sscanf(tok, "%d%c", &i1, &c) == 1 &&
-	       i1 >= 1970 && i1 < 2038) {
-      date.tm_year = i1 - 1900; have_year = TRUE;
-    } else if (sscanf(tok, "%d-%d-%d%c", &i1, &i2, &i3, &c) == 3 &&
-	       i1 >= 1970 && i1 < 2038 &&
-	       i2 >= 1 && i2 < 12 &&
-	       i3 >= 1 && i3 < 31) {
-      date.tm_year = i1 - 1900; have_year = TRUE;
-      date.tm_mon = i2 - 1; have_month = TRUE;
-      date.tm_mday = i3; have_day = TRUE;
-    } else if (sscanf(tok, "%d/%d/%d%c", &i1, &i2, &i3, &c) == 3 &&
-	       ((i1 >= 1970 && i1 < 2038) ||
-		(i1 >= 70 && i1 <= 99 && (i1 += 1900)) ||
-		(i1 >= 0 && i1 < 38 && (i1 += 2000))) &&
-	       i2 >= 1 && i2 < 12 &&
-	       i3 >= 1 && i3 < 31) {
-      date.tm_year = i1 - 1900; have_year = TRUE;
-      date.tm_mon = i2 - 1; have_month = TRUE;
-      date.tm_mday = i3; have_day = TRUE;
-    } else if (sscanf(tok, "%d/%d%c", &i1, &i2, &c) == 3 &&
-	       i1 >= 1 && i1 < 12 &&
-	       i2 >= 1 && i2 < 31) {
-      date.tm_mon = i1 - 1; have_month = TRUE;
-      date.tm_mday = i2; have_day = TRUE;
-    } else if (strcmp(tok, "GMT")==0) {
-      date.tm_isdst = 0; have_dst = TRUE;
-    } else if (strcmp(tok, "BST")==0) {
-      date.tm_isdst = 1; have_dst = TRUE;
     } else {
-      free(copystr);
-      return FALSE;
+      *d++ = *s;
     }
   }
-  /*--- If date given, assume midnight unless time given too */
-  if (have_year || have_month || have_day) {
-    if (!have_hour) date.tm_hour = 0;
-    if (!have_min) date.tm_min = 0;
-    if (!have_sec) date.tm_sec = 0;
-  } else {
-    /*--- Just a time today, but "" -> now */
-    if (have_min && !have_sec) date.tm_sec = 0;
-  }
-  if (! have_dst) {
-    if (utc) {
-      date.tm_isdst = 0;		/* Assume UK standard time is UTC */
-    } else {
-      date.tm_isdst = -1;		/* Let mktime work it out */
-    }
-  }
-  *p_time = mktime(&date);
-  free(copystr);
-  return TRUE;
+  *d = '\0';
+  return str;
 }
-  
-/*-----------------------------------------------------------------------
- *	Input converter
- *	Reads raw (binary) data from a producer via a conversion.
- *-----------------------------------------------------------------------*/
-typedef struct {
-  Producer child;
-  void *closure;
-  Conversion *conv;
-  Uscalar u;
-} Inconv;
 
-static void *inconv_create(Conversion *conv, Producer child, void *closure)
+/*--- Comma-separated numbers into a new *p_list; returns how many, or 0 */
+static int numlist(const char *str, double **p_list, char *msg)
 {
-  Inconv *this = NEW(Inconv);
-  this->child = child;
-  this->closure = closure;
-  this->conv = conv;
-  return this;
-}
-
-static int inconv_get(void *closure, char **data, int size)
-{
-  Inconv *this = closure;
-  Conversion *conv = this->conv;
-  char *str, *end;
-  int num = 0;
-  long lval = 0;
-
-  num = this->child(this->closure, &str, 1024);
-  if (num < 0) return -1;
-
-  switch (conv->type) {
-  case TYPE_CHAR: case TYPE_SHORT: case TYPE_INT: case TYPE_LONG:
-    switch (conv->style) {
-    case STYLE_DEFAULT:
-      lval = STRTOL(str, &end, 0);
-      break;
-    case STYLE_BINARY:
-      lval = 0L;
-      while (*str == '0' || *str == '1') {
-	lval *= 2;
-	if (*str == '1') lval += 1;
-	str++;
-      }
-      break;
-    case STYLE_OCTAL:
-      lval = STRTOL(str, &end, 8);
-      break;
-    case STYLE_DECIMAL:
-      lval = STRTOL(str, &end, 10);
-      break;
-    case STYLE_HEX:
-      lval = STRTOL(str, &end, 16);
-      break;
-    }
-    switch (conv->type) {
-    case TYPE_CHAR:
-      this->u.cval = lval;
-      *data = this->u.bytes;
-      num = sizeof(char);
-      break;
-    case TYPE_SHORT:
-      if (conv->byteswap) {
-	this->u.sval = bswap16(lval);
-      } else {
-	this->u.sval = lval;
-      }
-      *data = this->u.bytes;
-      num = sizeof(short);
-      break;
-    case TYPE_INT:
-      if (conv->byteswap) {
-	this->u.ival = bswap32(lval);
-      } else {
-	this->u.ival = lval;
-      }
-      *data = this->u.bytes;
-      num = sizeof(int);
-      break;
-    case TYPE_LONG:
-      if (conv->byteswap) {
-	if (sizeof(long) == 8) {	/* x86_64 */
-	  this->u.lval = bswap64(lval);
-	} else {
-	  this->u.lval = bswap32(lval);
-	}
-      } else {
-	this->u.lval = lval;
-      }
-      *data = this->u.bytes;
-      num = sizeof(long);
-      break;
-    default:;
-    }
-    break;
-  case TYPE_FLOAT:
-    this->u.fval = strtod(str, &end);
-    if (conv->byteswap) {
-      this->u.u32 = bswap32(this->u.u32); /* Assume u32 aliases fval */
-    }
-    *data = this->u.bytes;
-    num = sizeof(float);
-    break;
-  case TYPE_DOUBLE:
-    this->u.dval = strtod(str, &end);
-    if (conv->byteswap) {
-      this->u.u64 = bswap64(this->u.u64); /* Assume u64 aliases dval */
-    }
-    *data = this->u.bytes;
-    num = sizeof(double);
-    break;
-  case TYPE_STRING:
-    switch (conv->quoting) {
-    case QUOTING_NONE:
-      num = strlen(str);
-      *data = str;
-      break;
-    case QUOTING_SHELL:
-#if NOTYET
-      num = shell_unquote(str, buffer);
-#else
-      fail("Shell quoting not implemented yet");
-#endif
-      break;
-    case QUOTING_TCL:
-#if NOTYET
-      num = tcl_unquote(str, buffer);
-#else
-      fail("Tcl quoting not implemented yet");
-#endif
-      break;
-    } break;
-#if HAVE_POINT
-  case TYPE_POINT: {
-    c9error_jt err;
-    err = cdnmpak(this->u.pknam, str);
-    if (err != 0) {
-      c9report(EVSTM, err, NULL);
-      exit(1);
-    }
-    if (conv->byteswap) {
-      int i;
-      for (i = 0; i < sizeof(this->u.pknam) / sizeof(this->u.pknam[0]); i++) {
-	this->u.pknam[i] = bswap16(this->u.pknam[i]);
-      }
-    }
-    *data = this->u.bytes;
-    num = sizeof(this->u.pknam);
-  } break;
-#endif
-#if HAVE_BCN
-  case TYPE_BCN: {
-    int b, c, n;
-    if (sscanf(str, "%d %d %d", &b, &c, &n) == 3 ||
-	sscanf(str, "%d,%d,%d", &b, &c, &n) == 3) {
-      cmdbcn(&this->u.sval, b, c, n);
-      if (conv->byteswap) {
-	this->u.sval = bswap16(this->u.sval);
-      }
-      *data = this->u.bytes;
-      num = sizeof(short);
-    } else {
-      fail("Unrecognised BCN");
-    }
-  } break;
-#endif
-#if HAVE_NORDFLOAT
-  case TYPE_NORDFLOAT: {
-    union {
-      float fval;
-      short shalf[2];
-    } ieee;
-    ieee.fval = strtod(str, &end);
-#ifdef __linux__
-    {
-      /* Assume the "native" byte ordering for Nordfloat is three shorts
-       * in the same order as SunOS but each in native byte-order.
-       */
-      /*--- First convert into two shorts, big end first,
-       * ready for conversion.
-       * E.g. 3.14159265 -> 0x40490fdb -> [0x4049, 0x0fdb]
-       */
-      short hilo[2];
-      hilo[0] = ieee.shalf[1];
-      hilo[1] = ieee.shalf[0];
+  int n = 1, i;
+  const char *s;
+  char *end;
+  double *list;
 
-      /*--- Do the conversion e.g. -> [0x4002, 0xc90f, 0xdb00] */
-      cf32to48_(hilo, this->u.nf);
-    }
-#else
-    cf32to48_(ieee.shalf, this->u.nf);
-#endif
-    if (conv->byteswap) {
-      this->u.nf[0] = bswap16(this->u.nf[0]);
-      this->u.nf[1] = bswap16(this->u.nf[1]);
-      this->u.nf[2] = bswap16(this->u.nf[2]);
-    }
-    *data = this->u.bytes;
-    num = sizeof(this->u.nf);
-  } break;
-#endif
-  case TYPE_DATE: {
-    if (text2date(str, &this->u.time, /*utc=*/conv->unsignedp)) {
-      if (conv->byteswap) {
-	if (sizeof(this->u.time) == 8) {
-	  this->u.time = bswap64(this->u.time);
-	} else {
-	  this->u.time = bswap32(this->u.time);
-	}
-      }
-      *data = this->u.bytes;
-      num = sizeof(this->u.time);
-    } else {
-      fail("Unrecognised date");
+  for (s = str; *s; s++) {
+    if (*s == ',') n++;
+  }
+  list = malloc(n * sizeof(double));
+  for (s = str, i = 0; i < n; i++, s = end + 1) {
+    list[i] = strtod(s, &end);
+    if (end == s || (*end != ',' && *end != '\0')) {
+      complain(msg, "Bad number in %s", str);
+      free(list);
+      return 0;
     }
-  } break;
-  case TYPE_RAW:
-    fail("BUG: raw type in input converter");
   }
-
-  return num;
+  free(*p_list);
+  *p_list = list;
+  return n;
 }
 
-/*-----------------------------------------------------------------------
- *	Output conversion
- *-----------------------------------------------------------------------*/
-typedef struct {
-  Producer child;
-  void *closure;
-  Conversion *conv;
-  char buffer[40];
-} Outconv;
-
-static void *outconv_create(Conversion *conv, Producer child, void *closure)
+/*--- List of n values as one per channel, repeating a single value */
+static double *channels(double *list, int n, int nchannel)
 {
-  Outconv *this = NEW(Outconv);
-  this->child = child;
-  this->closure = closure;
-  this->conv = conv;
-  return this;
-}
-
-static int outconv_get(void *closure, char **data, int size)
-{
-  Outconv *this = closure;
-  Conversion *conv = this->conv;
-  char *str;
-  Uscalar u;
-  int num;
+  double *all;
   int i;
-
-#define GET(n) if ((num = this->child(this->closure, &str, n)) < 0) return -1
-#define GETD(p,n) GET(n); memcpy(p,str,n)
-
-  switch (conv->type) {
-  case TYPE_CHAR: case TYPE_SHORT: case TYPE_INT: case TYPE_LONG: {
-    long lval = 0;
-    switch (conv->type) {
-    case TYPE_CHAR:
-      size = sizeof(char);
-      GETD(u.bytes, size);
-      if (! conv->unsignedp &&
-	  (conv->style==STYLE_DECIMAL || conv->style == STYLE_DEFAULT)) {
-	lval = (signed char)u.cval;
-      } else {
-	lval = (unsigned char)u.cval;
-      }
-      break;
-    case TYPE_SHORT:
-      size = sizeof(short);
-      GETD(u.bytes, size);
-      if (conv->byteswap) {
-	u.sval = bswap16(u.sval);
-      }
-      if (! conv->unsignedp &&
-	  (conv->style==STYLE_DECIMAL || conv->style == STYLE_DEFAULT)) {
-	lval = (signed short)u.sval;
-      } else {
-	lval = (unsigned short)u.sval;
-      }
-      break;
-    case TYPE_INT:
-      size = sizeof(int);
-      GETD(u.bytes, size);
-      if (conv->byteswap) {
-	u.ival = bswap32(u.ival);
-      }
-      if (! conv->unsignedp &&
-	  (conv->style==STYLE_DECIMAL || conv->style == STYLE_DEFAULT)) {
-	lval = (signed int)u.ival;
-      } else {
-	lval = (unsigned int)u.ival;
-      }
-      break;
-    case TYPE_LONG:
-      size = sizeof(long);
-      GETD(u.bytes, size);
-      if (conv->byteswap) {
-	if (sizeof(long) == 8) {	/* x86_64 */
-	  u.lval = bswap64(u.lval);
-	} else {
-	  u.lval = bswap32(u.lval);
-	}
-      }
-      lval = u.lval;
-      break;
-    default:;
-    }
-    switch (conv->style) {
-    case STYLE_BINARY:
-      size *= 8;
-      for (i=0; i<size; i++) {
-	this->buffer[i] = (lval & (1 << (size-1 - i))) ? '1' : '0';
-      }
-      this->buffer[size] = 0;
-      break;
-    case STYLE_OCTAL:
-      sprintf(this->buffer, "%lo", lval);
-      break;
-    case STYLE_DEFAULT: case STYLE_DECIMAL:
-      if (! conv->unsignedp) {
-	sprintf(this->buffer, "%ld", lval);
-      } else {
-	sprintf(this->buffer, "%lu", lval);
-      }
-      break;
-    case STYLE_HEX:
-      sprintf(this->buffer, "%lx", lval);
-      break;
-    }
-    *data = this->buffer;
-  } break;
-  case TYPE_FLOAT:
-    GETD(u.bytes, sizeof(float));
-    if (conv->byteswap) {
-      u.u32 = bswap32(u.u32);
-    }
-    sprintf(this->buffer, "%g", u.fval);
-    *data = this->buffer;
-    break;
-  case TYPE_DOUBLE:
-    GETD(u.bytes, sizeof(double));
-    if (conv->byteswap) {
-      u.u64 = bswap64(u.u64);
-    }
-    sprintf(this->buffer, "%g", u.dval);
-    *data = this->buffer;
-    break;
-  case TYPE_STRING:
-    GET(1024);
-    *data = str;
-    return num;
-    break;
-#if HAVE_POINT
-  case TYPE_POINT:
-    GETD(u.bytes, sizeof(u.pknam));
-    if (conv->byteswap) {
-      int i;
-      for (i = 0; i < sizeof(u.pknam) / sizeof(u.pknam[0]); i++) {
-	u.pknam[i] = bswap16(u.pknam[i]);
-      }
-    }
-    cdnmupk(u.pknam, this->buffer, 1);
-    *data = this->buffer;
-    break;
-#endif
-#if HAVE_BCN
-  case TYPE_BCN: {
-    int b, c, n;
-    GETD(u.bytes, sizeof(short));
-    if (conv->byteswap) {
-      u.sval = bswap16(u.sval);
-    }
-    cmgbcn(u.sval, &b, &c, &n);
-    sprintf(this->buffer, "%d,%d,%d", b, c, n);
-    *data = this->buffer;
-  } break;
-#endif
-#if HAVE_NORDFLOAT
-  case TYPE_NORDFLOAT: {
-    union {
-      double dval;
-      short spart[4];
-    } ieee;
-    GETD(u.nf, 6);
-    if (conv->byteswap) {
-      u.nf[0] = bswap16(u.nf[0]);
-      u.nf[1] = bswap16(u.nf[1]);
-      u.nf[2] = bswap16(u.nf[2]);
-    }
-#ifdef __linux__
-    {
-      /* Assume the "native" byte ordering for Nordfloat is three shorts
-       * in the same order as SunOS but each in native byte-order.
-       */
-      short bigout[4];
-      cf48to64_(u.nf, bigout);
-      ieee.spart[0] = bigout[3];
-      ieee.spart[1] = bigout[2];
-      ieee.spart[2] = bigout[1];
-      ieee.spart[3] = bigout[0];
-    }
-#else
-    cf48to64_(u.nf, ieee.spart);
-#endif
-    sprintf(this->buffer, "%g", ieee.dval);
-    *data = this->buffer;
-  } break;
-#endif
-  case TYPE_DATE: {
-    struct tm tm;
-    char buf[40];
-    GETD(u.bytes, sizeof(time_t));
-    if (conv->byteswap) {
-      if (sizeof(u.time) == 8) {
-	u.time = bswap64(u.time);
-      } else {
-	u.time = bswap32(u.time);
-      }
-    }
-    /*--- N.B. ctime/localtime use rules to determine when BST is in
-     * effect, but it seems (on gen-off-8 on 1999-12-14 at least) that
-     * the current ruleset has summer time continuous from the beginning
-     * of time until Autumn 1971,
-     * e.g. "cconv -y 0" yields "Thu Jan  1 01:00:00 1970"
-     */
-    if (conv->unsignedp) {		/* "unsigned" overloaded as "UTC" */
-      gmtime_r(&u.time, &tm);
-    } else {
-      localtime_r(&u.time, &tm);
-    }
-    strcpy(this->buffer, asctime_r(&tm, buf));
-    this->buffer[24] = '\0';		/* Zap newline */
-    *data = this->buffer;
-  } break;
-  case TYPE_RAW:
-    fail("BUG: raw type in output converter");
+  if (n == 0 || n == nchannel) return list;
+  all = malloc(nchannel * sizeof(double));
+  for (i = 0; i < nchannel; i++) {
+    all[i] = list[0];
   }
-
-  return strlen(*data);
+  free(list);
+  return all;
 }
 
 /*-----------------------------------------------------------------------
  *	Read options
+ *	Sets up both conversions and run, leaving in run the arguments to
+ *	be converted.  --serve is only recognised if p_serve is given.
+ *	Returns the number of errors.
  *-----------------------------------------------------------------------*/
-int main(int argc, char **argv)
+static int options(int argc, char **argv, Conversion *inconv,
+		   Conversion *outconv, CconvOptions *run, const char **p_serve,
+		   char *msg)
 {
-  Conversion *inconv, *outconv;
   char *opt;
   int error = 0;
-  Producer prod;
-  void *stream;
-  const char *infile = NULL;
   char *str;
-  int num;
-
-  progname = *argv++;
-  argc--;
-
-  inconv = conversion_create();
-  outconv = conversion_create();
+  double *scale = NULL, *offset = NULL;
+  int nscale = 0, noffset = 0;
+  int intype = FALSE;			/* Input type given */
 
   /*
    * Decode any command line options
    * Heuristic: "-<letter>" is option, "-?" is request for help,
-   * "-<digit>..." is an argument to be converted.
+   * "-<digit>..." is an argument to be converted,
+   * "--<letter>..." is a long option.
    */
   for (; argc > 0 && (*argv)[0]=='-' &&
-	 (isalpha((unsigned char)(*argv)[1]) || (*argv)[1]=='?');
+	 (isalpha((unsigned char)(*argv)[1]) || (*argv)[1]=='?' ||
+	  ((*argv)[1]=='-' && isalpha((unsigned char)(*argv)[2])));
        argv++,argc--) {
+    if ((*argv)[1] == '-') {
+      char *name = *argv + 2;
+      char *value = strchr(name, '=');
+      int namelen = value ? value++ - name : strlen(name);
+#define LONGOPT(s) (namelen == sizeof(s)-1 && strncmp(name, s, namelen) == 0)
+      if (LONGOPT("sep")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else run->sep = unescape(value);
+      } else if (LONGOPT("width")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((outconv->width = atoi(value)) <= 0 ||
+		 outconv->width > FORMAT_MAXWIDTH) {
+	  complain(msg, "Bad width %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("jobs")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((run->njob = atoi(value)) <= 0) {
+	  complain(msg, "Bad number of jobs %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("skip")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((run->skip = atol(value)) < 0 || !isdigit((unsigned char)*value)) {
+	  complain(msg, "Bad number of bytes to skip %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("count")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((run->count = atol(value)) <= 0) {
+	  complain(msg, "Bad count %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("stride")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if (run->stride > 1 || (run->stride = atoi(value)) <= 0) {
+	  complain(msg, "Bad or second stride %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("channel")) {
+	int ch, nch;
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if (sscanf(value, "%d/%d", &ch, &nch) != 2 || ch < 0 || ch >= nch ||
+		 run->stride > 1) {
+	  complain(msg, "Bad or second channel %s, e.g. 0/4", value);
+	  error++;
+	} else {
+	  run->first = ch;
+	  run->stride = nch;
+	}
+      } else if (LONGOPT("record")) {
+	if ((run->record = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+      } else if (LONGOPT("epoch")) {
+	static char const * const units[] = { "s", "ms", "us", "ns", "double" };
+	int i;
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else {
+	  for (i = 0; i < 5 && strcmp(value, units[i]) != 0; i++)
+	    ;
+	  if (i < 5) {
+	    inconv->epoch = outconv->epoch = (enum Epoch)i;
+	  } else {
+	    complain(msg, "Bad epoch %s", value);
+	    error++;
+	  }
+	}
+      } else if (LONGOPT("stats")) {
+	if (value == NULL) run->stats = STATS_TEXT;
+	else if (strcmp(value, "json") == 0) run->stats = STATS_JSON;
+	else {
+	  complain(msg, "Bad stats format %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("serve") && p_serve != NULL) {
+	*p_serve = value ? value : "";
+      } else if (LONGOPT("scale")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL ||
+	    (nscale = numlist(value, &scale, msg)) == 0) error++;
+      } else if (LONGOPT("offset")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL ||
+	    (noffset = numlist(value, &offset, msg)) == 0) error++;
+      } else if (LONGOPT("decimate")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((run->decimate = atol(value)) <= 0) {
+	  complain(msg, "Bad number of values to decimate %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("points")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((run->points = atol(value)) <= 0) {
+	  complain(msg, "Bad number of points %s", value);
+	  error++;
+	}
+      } else if (LONGOPT("mean")) {
+	run->mean = TRUE;
+      } else if (LONGOPT("aggregate")) {
+	run->aggregate = TRUE;
+      } else if (LONGOPT("histogram")) {
+	char c;
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if (sscanf(value, "%d,%lf,%lf%c", &run->nbin, &run->lo, &run->hi,
+			&c) != 3 || run->nbin <= 0 || !(run->lo < run->hi)) {
+	  complain(msg, "Bad histogram %s, e.g. 10,0,1", value);
+	  error++;
+	} else {
+	  run->aggregate = TRUE;
+	}
+      } else if (LONGOPT("wrap")) {
+	outconv->wrap = TRUE;
+      } else if (LONGOPT("truncate")) {
+	outconv->truncate = TRUE;
+      } else if (LONGOPT("shortest")) {
+	outconv->precision = PRECISION_SHORTEST;
+      } else if (LONGOPT("precision")) {
+	if ((value = optvalue(value, &argc, &argv, msg)) == NULL) error++;
+	else if ((outconv->precision = atoi(value)) <= 0 ||
+		 outconv->precision > 40) {
+	  complain(msg, "Bad precision %s", value);
+	  error++;
+	}
+      } else {
+	complain(msg, "Unknown option --%.*s", namelen, name);
+	error++;
+      }
+#undef LONGOPT
+      continue;
+    }
     for (opt=argv[0]+1; *opt; opt++) {
+      if (strchr("ILHCFGSBPJY", *opt)) intype = TRUE;
       switch (*opt) {
       case 'I': inconv->type = TYPE_INT; break;
       case 'i': outconv->type = TYPE_INT; break;
@@ -1006,7 +397,7 @@ int main(int argc, char **argv)
       case 'b': outconv->type = TYPE_BCN; break;
 #else
       case 'B': case 'b':
-	fprintf(stderr, "-b/-B not supported on this platform\n");
+	complain(msg, "-b/-B not supported on this platform");
 	error++;
 	break;
 #endif
@@ -1015,18 +406,18 @@ int main(int argc, char **argv)
       case 'p': outconv->type = TYPE_POINT; break;
 #else
       case 'P': case 'p':
-	fprintf(stderr, "-P/-p not supported on this platform\n");
+	complain(msg, "-P/-p not supported on this platform");
 	error++;
 	break;
 #endif
-      case 'R': inconv->type = TYPE_RAW; break;
-      case 'r': outconv->type = TYPE_RAW; break;
+      case 'R': inconv->raw = TRUE; break;
+      case 'r': outconv->raw = TRUE; break;
 #if HAVE_NORDFLOAT
       case 'J': inconv->type = TYPE_NORDFLOAT; break;
       case 'j': outconv->type = TYPE_NORDFLOAT; break;
 #else
       case 'J': case 'j':
-	fprintf(stderr, "-P/-p not supported on this platform\n");
+	complain(msg, "-P/-p not supported on this platform");
 	error++;
 	break;
 #endif
@@ -1051,217 +442,326 @@ int main(int argc, char **argv)
       case 'u': outconv->unsignedp = TRUE; break;
       case 'E': inconv->byteswap = TRUE; break;
       case 'e': outconv->byteswap = TRUE; break;
+      case 'M': run->split = TRUE; break;
+
+      case 'm':
+	/*--- Values per line expected - either in this arg, or next */
+	if (*(opt+1) != '\0') {
+	  str = opt + 1;
+	  opt += strlen(opt) - 1;	/* To terminate loop */
+	} else if (argc == 1) {
+	  str = NULL;
+	} else {
+	  argv++, argc--;
+	  str = *argv;
+	}
+	if (str == NULL || (run->perline = atoi(str)) <= 0) {
+	  complain(msg, "Missing or bad count after -m");
+	  error++;
+	}
+	break;
 
       case 'N':
 	/*--- Input filename expected - either in this arg, or next */
-	if (infile) {
-	  fprintf(stderr, "Only one -N option allowed\n");
+	if (run->infile) {
+	  complain(msg, "Only one -N option allowed");
 	  error++;
 	} else if (*(opt+1) != '\0') {
 	  opt++;
-	  infile = opt;
-	  opt += strlen(infile) - 1;	/* To terminate loop */
+	  run->infile = opt;
+	  opt += strlen(opt) - 1;	/* To terminate loop */
 	} else {
 	  if (argc == 1) {
-	    fprintf(stderr, "Missing filename after -N\n");
+	    complain(msg, "Missing filename after -N");
 	    error++;
 	  } else {
 	    argv++, argc--;
-	    infile = *argv;
+	    run->infile = *argv;
 	  }
 	}
 	break;
-      default: error++;
+      default:
+	complain(msg, "Unknown option -%c", *opt);
+	error++;
       }
     }
   }
-  if (error) {
-    fprintf(stderr, usage, progname);
-    exit(200);
+  if (inconv->raw && !intype) {
+    /*--- Raw data of no given type is of the numeric output type */
+    switch (outconv->type) {
+    case TYPE_CHAR: case TYPE_SHORT: case TYPE_INT: case TYPE_LONG:
+    case TYPE_FLOAT: case TYPE_DOUBLE:
+      inconv->type = outconv->type;
+      break;
+    default:
+      break;
+    }
+  }
+  if (run->record && (inconv->byteswap || outconv->byteswap)) {
+    complain(msg, "Byte order of --record is given by its layout");
+    error++;
+  }
+  if (run->decimate && run->points) {
+    complain(msg, "Only one of --decimate and --points");
+    error++;
+  } else if (run->mean && !run->decimate && !run->points) {
+    complain(msg, "--mean needs --decimate or --points");
+    error++;
+  }
+  if (nscale || noffset) {
+    /*--- One value per channel, or one for all */
+    run->nchannel = nscale > noffset ? nscale : noffset;
+    if ((nscale > 1 && nscale != run->nchannel) ||
+	(noffset > 1 && noffset != run->nchannel)) {
+      complain(msg, "--scale and --offset need 1 or the same number of values");
+      error++;
+    }
+    run->scale = scale = channels(scale, nscale, run->nchannel);
+    run->offset = offset = channels(offset, noffset, run->nchannel);
   }
   if (argc >= 1 && (*argv)[0]=='-' && (*argv)[1]=='-' && (*argv)[2]=='\0') {
     /*--- "--" signified end of options */
     argv++; argc--;
   }
+  run->argc = argc;
+  run->argv = argv;
+  return error;
+}
 
-  if (infile) {
-    /*--- Expect filename from which to read data, or "-" for stdin */
-    if (argc != 0) {
-      fprintf(stderr, usage, progname);
-      exit(200);
-    }
-    stream = file_create(infile);
-    if (inconv->type == TYPE_RAW) {
-      prod = file_get_raw;
-    } else {
-      prod = file_get;
-    }
+/*-----------------------------------------------------------------------
+ *	Coprocess server
+ *	Each line is a request of options and values as for the command,
+ *	e.g. "-Hx 1234", split at white space except within quotes.  The
+ *	answer is one line of the converted values, separated by spaces
+ *	unless --sep is given, or "error: <message>"; a blank request, or
+ *	a conversion giving no values, is answered by an empty line.  With
+ *	a socket path, each client connection is served by its own thread.
+ *-----------------------------------------------------------------------*/
+#define SERVE_WORDS 1024
 
-  } else {
-    /*--- Get strings from command line args */
-    if (argc == 0) {			/* Need at least one value */
-      fprintf(stderr, usage, progname);
-      exit(200);
+static THREAD_LOCAL jmp_buf serve_jump;
+static THREAD_LOCAL char *serve_msg;
+
+/*--- Conversion failure: abandon the request */
+static void serve_fail(const char *msg)
+{
+  snprintf(serve_msg, MSG_SIZE, "%s", msg);
+  longjmp(serve_jump, 1);
+}
+
+/*--- Split line into words in place; returns how many */
+static int serve_words(char *line, char **words)
+{
+  char *s = line, *d;
+  int n = 0, quote;
+  for (;;) {
+    while (isspace((unsigned char)*s)) s++;
+    if (*s == '\0' || n == SERVE_WORDS) break;
+    words[n++] = d = s;
+    for (quote = 0; *s && (quote || !isspace((unsigned char)*s)); s++) {
+      if (*s == quote) {
+	quote = 0;
+      } else if (!quote && (*s == '\'' || *s == '"')) {
+	quote = *s;
+      } else {
+	*d++ = *s;
+      }
     }
-    stream = argv_create(argc, argv);
-    prod = argv_get;
+    if (*s) s++;
+    *d = '\0';
   }
+  return n;
+}
 
-  if (inconv->type != TYPE_RAW) {
-    /*--- Apply input conversion */
-    stream = inconv_create(inconv, prod, stream);
-    prod = inconv_get;
+static void serve_write(int fd, const char *data, long len)
+{
+  long num;
+  while (len > 0) {
+    num = write(fd, data, len);
+    if (num < 0) {
+      if (errno == EINTR) continue;
+      return;				/* Client gone */
+    }
+    data += num;
+    len -= num;
   }
+}
 
-  /*--- Data produced can have variable sizes; truncate to what asked for */
-  stream = reducer_create(prod, stream);
-  prod = reducer_get;
-
-  if (outconv->type == TYPE_RAW) {
-    while ((num = prod(stream, &str, 1024)) >= 0) {
-      fwrite(str, 1, num, stdout);
-    }
+/*--- Answer one request line on fd, growing *p_out as needed */
+static void serve_request(char *line, int fd, char **p_out, long *p_size)
+{
+  Conversion *inconv = conversion_create();
+  Conversion *outconv = conversion_create();
+  CconvOptions run;
+  char *words[SERVE_WORDS];
+  char msg[MSG_SIZE];
+  char *src = NULL;
+  long srclen, len;
+  int nword, i;
+
+  msg[0] = '\0';
+  serve_msg = msg;
+  cconv_options_init(&run);
+  nword = serve_words(line, words);
+  if (nword == 0) {
+    serve_write(fd, "\n", 1);		/* Still one line per request */
+    goto done;
+  }
+  if (options(nword, words, inconv, outconv, &run, NULL, msg) == 0) {
+    if (run.infile) complain(msg, "-N not allowed with --serve");
+    else if (outconv->raw) complain(msg, "-r not allowed with --serve");
+    else if (run.njob != 1) complain(msg, "--jobs not allowed with --serve");
+    else if (run.stats) complain(msg, "--stats not allowed with --serve");
+    else if (run.argc == 0) complain(msg, "No values");
   } else {
-    /*--- Unless outputting strings, pad to required size */
-    if (outconv->type != TYPE_STRING) {
-      stream = expander_create(prod, stream);
-      prod = expander_get;
-    }
+    complain(msg, "Bad options");
+  }
+  if (msg[0] != '\0') goto done;
 
-    /*--- Convert to output strings */
-    stream = outconv_create(outconv, prod, stream);
-    prod = outconv_get;
+  /*--- Values one per line as text, or end to end as raw */
+  for (srclen = 0, i = 0; i < run.argc; i++) {
+    srclen += strlen(run.argv[i]) + 1;
+  }
+  src = malloc(srclen);
+  for (srclen = 0, i = 0; i < run.argc; i++) {
+    len = strlen(run.argv[i]);
+    memcpy(src + srclen, run.argv[i], len);
+    srclen += len;
+    if (!inconv->raw) src[srclen++] = '\n';
+  }
+  if (run.sep == NULL && run.perline == 0) run.sep = " ";
+  if (setjmp(serve_jump) == 0) {
+    while ((len = cconv_convert(src, srclen, inconv, *p_out, *p_size,
+				outconv, &run)) < 0) {
+      free(*p_out);
+      *p_out = malloc(*p_size *= 2);
+    }
+    serve_write(fd, *p_out, len);
+    if (len == 0) serve_write(fd, "\n", 1);	/* Still a reply if no values */
+  }
 
-    while ((num = prod(stream, &str, 1024)) >= 0) {
-      printf("%s\n", str);
-    }
+ done:
+  if (msg[0] != '\0') {
+    serve_write(fd, "error: ", 7);
+    serve_write(fd, msg, strlen(msg));
+    serve_write(fd, "\n", 1);
   }
-  
-  return 0;
+  free(src);
+  free((void *)run.scale);
+  free((void *)run.offset);
+  conversion_free(inconv);
+  conversion_free(outconv);
 }
 
-/*-----------------------------------------------------------------------
- *	Memory allocator
- *-----------------------------------------------------------------------*/
-static void *new(int size)
+/*--- Requests from in until end of file, answers on fd */
+static void serve_stream(FILE *in, int fd)
 {
-  void *this;
-  this = malloc(size);
-  if (this == NULL) {
-    fprintf(stderr, "%s: Out of memory\n", progname);
-    exit(1);
+  long size = 65536, outsize = 65536;
+  char *line = malloc(size), *out = malloc(outsize);
+  long len;
+
+  while (fgets(line, size, in) != NULL) {
+    len = strlen(line);
+    while (len == size - 1 && line[len-1] != '\n') {
+      line = realloc(line, size *= 2);
+      if (fgets(line + len, size - len, in) == NULL) break;
+      len += strlen(line + len);
+    }
+    serve_request(line, fd, &out, &outsize);
   }
-  return this;
+  free(line);
+  free(out);
 }
 
-static void fail(const char *fmt, ...)
+static void *serve_client(void *closure)
 {
-  va_list ap;
-  fprintf(stderr, "%s: ", progname);
-  va_start(ap,fmt);
-  vfprintf(stderr, fmt, ap);
-  va_end(ap);
-  fprintf(stderr, "\n");
-  exit(1);
+  int fd = (int)(long)closure;
+  FILE *in = fdopen(fd, "r");
+  if (in != NULL) {
+    serve_stream(in, fd);
+    fclose(in);
+  } else {
+    close(fd);
+  }
+  return NULL;
 }
 
-#ifdef __sunos5__
-static uint16_t
-bswap16(uint16_t x)
+static int serve(const char *path)
 {
-  union {
-    uint16_t v;
-    char b[2];
-  } in, out;
-  in.v = x;
-  out.b[0] = in.b[1];
-  out.b[1] = in.b[0];
-  return out.v;
+  struct sockaddr_un addr;
+  struct stat st;
+  pthread_t thread;
+  int sock, fd;
+
+  cconv_fail = serve_fail;
+  if (*path == '\0') {
+    serve_stream(stdin, STDOUT_FILENO);
+    return 0;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: Socket path too long: %s\n", cconv_progname, path);
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);			/* Left by an earlier server */
+  }
+  if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(sock, 16) != 0) {
+    fprintf(stderr, "%s: Cannot serve on %s: %s\n", cconv_progname, path,
+	    strerror(errno));
+    return 1;
+  }
+  for (;;) {
+    if ((fd = accept(sock, NULL, NULL)) < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      fprintf(stderr, "%s: accept: %s\n", cconv_progname, strerror(errno));
+      return 1;
+    }
+    if (pthread_create(&thread, NULL, serve_client, (void *)(long)fd) != 0) {
+      close(fd);
+    } else {
+      pthread_detach(thread);
+    }
+  }
 }
 
-static uint32_t
-bswap32(uint32_t x)
+int main(int argc, char **argv)
 {
-  union {
-    uint32_t v;
-    char b[4];
-  } in, out;
-  in.v = x;
-  out.b[0] = in.b[3];
-  out.b[1] = in.b[2];
-  out.b[2] = in.b[1];
-  out.b[3] = in.b[0];
-  return out.v;
-}
+  Conversion *inconv, *outconv;
+  CconvOptions run;
+  const char *serve_path = NULL;
 
-static uint64_t
-bswap64(uint64_t x)
-{
-  union {
-    uint64_t v;
-    char b[2];
-  } in, out;
-  in.v = x;
-  out.b[0] = in.b[7];
-  out.b[1] = in.b[6];
-  out.b[2] = in.b[5];
-  out.b[3] = in.b[4];
-  out.b[4] = in.b[3];
-  out.b[5] = in.b[2];
-  out.b[6] = in.b[1];
-  out.b[7] = in.b[0];
-  return out.v;
-}
+  cconv_progname = *argv++;
+  argc--;
 
-#endif
+  inconv = conversion_create();
+  outconv = conversion_create();
+  cconv_options_init(&run);
+  if (options(argc, argv, inconv, outconv, &run, &serve_path, NULL) != 0) {
+    fprintf(stderr, usage, cconv_progname);
+    exit(200);
+  }
+  if (serve_path != NULL) {
+    return serve(serve_path);
+  }
 
-#if NOTYET
-int shell_unquote(char *s, char *dest)
-{
-  int c;
-  char *d = dest;
-  for (;;) {
-    c = *s++;
-    if (c == 0) {
-      break;
-    } else if (c == '\'') {
-      for (;;) {
-	c = *s++;
-	if (c == 0) break;
-	if (c == '\'') {
-	  break;
-	} else {
-	  *d++ = c;
-	}
-      }
-      if (c == 0) break;
-    } else if (c == '"') {
-      for (;;) {
-	c = *s++;
-	if (c == 0) break;
-	if (c == '"') {
-	  break;
-	} else if (c == '\\') {
-	  c = *s++;
-	  if (c == 0) break;
-	  if (c != '"' && c != '\\') {
-	    *d++ = '\\';
-	  }
-	  *d++ = c;
-	} else {
-	  *d++ = c;
-	}
-      }
-      if (c == 0) break;
-    } else if (c == '\\') {
-      c = *s++;
-      if (c == 0) break;
-      *d++ = c;
-    } else {
-      *d++ = c;
+  if (run.infile) {
+    /*--- Expect filename from which to read data, or "-" for stdin */
+    if (run.argc != 0) {
+      fprintf(stderr, usage, cconv_progname);
+      exit(200);
+    }
+  } else {
+    /*--- Get strings from command line args */
+    if (run.argc == 0 || run.skip) {		/* Need at least one value */
+      fprintf(stderr, usage, cconv_progname);
+      exit(200);
     }
   }
-  num = d - dest;
+  return cconv_run(inconv, outconv, &run);
 }
-
-#endif
@@ -0,0 +1,4852 @@
+/*=======================================================================
+ *	Conversion library behind cconv
+ *	Values are read as text or raw binary through a chain of producer
+ *	stages and written as text or raw binary, between a file (or
+ *	strings) and stdout, or from one memory buffer to another.
+ *	See libcconv.h for the interface and cconv.c for the options.
+ *=======================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory.h>
+#include <ctype.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include "libcconv.h"
+
+#if HAVE_NORDFLOAT
+# include <csl3.h>			/* cf32to48_ etc. */
+#endif
+#if HAVE_POINT
+# include <cddefs.h>
+# include <csl9.h>
+#endif
+/* Avoid need to call csl4 functions */
+#define cmgbcn(bcn,b,c,n) (*(b) = (bcn)>>11, *(c)=((bcn)>>5)&63, *(n)=(bcn)&31)
+#define cmdbcn(bcn,b,c,n) (*(bcn) = (((b)&15)<<11) | (((c)&63)<<5) | ((n)&31))
+
+#ifdef __sunos5__
+/*--- Ancient gcc, lacks builtins */
+static uint16_t bswap16(uint16_t x);
+static uint32_t bswap32(uint32_t x);
+static uint64_t bswap64(uint64_t x);
+#else
+#define bswap16 __builtin_bswap16
+#define bswap32 __builtin_bswap32
+#define bswap64 __builtin_bswap64
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define NEW(t) (t *)new(sizeof(t))
+
+/*--- Number of values passed between stages in one block */
+#define BLOCK_VALUES 4096
+
+static void *new(size_t);
+static void release(void *);
+static void pool_begin(void);
+static void pool_end(void);
+static void fail(const char *, ...);
+
+/*-----------------------------------------------------------------------
+ *	Conversion control
+ *-----------------------------------------------------------------------*/
+
+
+Conversion *conversion_create(void)
+{
+  Conversion *this = NEW(Conversion);
+  this->type = TYPE_INT;
+  this->style = STYLE_DEFAULT;
+  this->quoting = QUOTING_NONE;
+  this->unsignedp = FALSE;
+  this->byteswap = FALSE;
+  this->raw = FALSE;
+  this->width = 0;
+  this->precision = 0;
+  this->epoch = EPOCH_SECONDS;
+  this->wrap = FALSE;
+  this->truncate = FALSE;
+  return this;
+}
+
+void conversion_free(Conversion *conv)
+{
+  release(conv);
+}
+
+typedef union {
+  char cval;
+  short sval;
+  int ival;
+  long lval;				/* 32-bit or 64-bit per architecture */
+  float fval;
+  double dval;
+  time_t time;
+#if HAVE_POINT
+  pknam_t pknam;
+#endif
+#if HAVE_NORDFLOAT
+  short nf[3];
+#endif
+  uint32_t u32;
+  uint64_t u64;
+  int64_t i64;
+  char bytes[8];
+} Uscalar;
+
+/*--- Size of one binary value, or 0 if variable (string) */
+static int conversion_size(const Conversion *conv)
+{
+  switch (conv->type) {
+  case TYPE_CHAR:	return sizeof(char);
+  case TYPE_SHORT:	return sizeof(short);
+  case TYPE_INT:	return sizeof(int);
+  case TYPE_LONG:	return sizeof(long);
+  case TYPE_FLOAT:	return sizeof(float);
+  case TYPE_DOUBLE:	return sizeof(double);
+#if HAVE_POINT
+  case TYPE_POINT:	return sizeof(pknam_t);
+#endif
+#if HAVE_BCN
+  case TYPE_BCN:	return sizeof(short);
+#endif
+#if HAVE_NORDFLOAT
+  case TYPE_NORDFLOAT:	return 3*sizeof(short);
+#endif
+  case TYPE_DATE:
+    return conv->epoch == EPOCH_SECONDS ? sizeof(time_t) : sizeof(int64_t);
+  case TYPE_STRING:	break;
+  }
+  return 0;
+}
+
+/*--- Width of the units whose bytes are reversed by byte-swapping */
+static int conversion_swapsize(const Conversion *conv)
+{
+  switch (conv->type) {
+#if HAVE_POINT
+  case TYPE_POINT:	return sizeof(short);
+#endif
+#if HAVE_NORDFLOAT
+  case TYPE_NORDFLOAT:	return sizeof(short);
+#endif
+  default:		return conversion_size(conv);
+  }
+}
+
+/*=======================================================================
+ *	Data producer stream
+ *	Returns pointer to data, and size (may be what asked for, or not).
+ *	Returns -1 when end reached.
+ *	The data belongs to the producer and remains valid only until its
+ *	next call, so each stage reuses its own buffers and memory use does
+ *	not grow with the amount of data.
+ *	Stages with fixed-size values have a "_block" variant which hands
+ *	over up to BLOCK_VALUES values per call; the plain variant moves
+ *	one value at a time.
+ *=======================================================================*/
+typedef int(*Producer)(void *, char **, int);
+
+const char *cconv_progname = "cconv";
+void (*cconv_fail)(const char *msg) = NULL;
+
+/*-----------------------------------------------------------------------
+ *	Statistics
+ *	A meter between two stages counts the calls, values and bytes
+ *	passing up the chain and the time spent below it.  Meters are only
+ *	put in the chain when statistics are asked for, so cost nothing
+ *	otherwise.  As the chain is linear, the time of each stage itself
+ *	is its total less that of the meter below it.
+ *	Times are kept in ticks of the x86 time-stamp counter where there
+ *	is one, as reading the clock can cost more than converting a
+ *	value, and scaled to nanoseconds by the clock over the whole run.
+ *	Stages passing one value per call still include the cost of their
+ *	meters, some tens of nanoseconds per call.
+ *-----------------------------------------------------------------------*/
+#define STATS_STAGES 16
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(__sunos5__)
+# include <x86intrin.h>
+# define stats_now() ((long long)__rdtsc())
+#else
+# define stats_now() stats_clock()
+#endif
+
+typedef struct {
+  const char *name;
+  int unit;				/* Bytes per value, 0: one per call */
+  long calls;
+  long long values, bytes;
+  long long ns;				/* Ticks, including stages below */
+} Stage;
+
+typedef struct {
+  int nstage;
+  Stage stage[STATS_STAGES];		/* From the source up */
+  Stage write;				/* Within the last stage */
+  long long start, clock;		/* Ticks and ns at start */
+} Stats;
+
+static long long stats_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static Stats *stats_create(void)
+{
+  Stats *this = NEW(Stats);
+  memset(this, 0, sizeof(*this));
+  this->write.name = "write";
+  this->clock = stats_clock();
+  this->start = stats_now();
+  return this;
+}
+
+static Stage *stats_stage(Stats *this, const char *name, int unit)
+{
+  Stage *stage = &this->stage[this->nstage];
+  if (this->nstage < STATS_STAGES - 1) this->nstage++;
+  memset(stage, 0, sizeof(*stage));
+  stage->name = name;
+  stage->unit = unit;
+  return stage;
+}
+
+static void stats_count(Stage *stage, int num)
+{
+  stage->calls++;
+  if (num < 0) return;
+  stage->bytes += num;
+  stage->values += stage->unit ? num / stage->unit : 1;
+}
+
+static void stats_report(Stats *this, enum StatsFormat format)
+{
+  long long ticks = stats_now() - this->start;
+  long long total = stats_clock() - this->clock;
+  double scale = ticks > 0 ? (double)total / ticks : 1.0;
+  long long self;
+  Stage *stage;
+  int i;
+
+  if (format == STATS_JSON) {
+    fprintf(stderr, "{\"stages\":[");
+  } else {
+    fprintf(stderr, "%s: %-10s %10s %12s %14s %12s %9s\n", cconv_progname,
+	    "stage", "calls", "values", "bytes", "self ms", "ns/value");
+  }
+  for (i = 0; i <= this->nstage; i++) {
+    stage = i < this->nstage ? &this->stage[i] : &this->write;
+    self = stage->ns;
+    if (i > 0 && i < this->nstage) self -= this->stage[i-1].ns;
+    if (i == this->nstage - 1) self -= this->write.ns;
+    if (format == STATS_JSON) {
+      fprintf(stderr, "%s{\"stage\":\"%s\",\"calls\":%ld,\"values\":%lld,"
+	      "\"bytes\":%lld,\"ns\":%lld,\"self_ns\":%lld}", i ? "," : "",
+	      stage->name, stage->calls, stage->values, stage->bytes,
+	      (long long)(stage->ns * scale), (long long)(self * scale));
+    } else {
+      fprintf(stderr, "%s: %-10s %10ld %12lld %14lld %12.3f %9.1f\n",
+	      cconv_progname, stage->name, stage->calls, stage->values,
+	      stage->bytes, self * scale / 1e6,
+	      stage->values ? self * scale / stage->values : 0.0);
+    }
+  }
+  if (format == STATS_JSON) {
+    fprintf(stderr, "],\"total_ns\":%lld}\n", total);
+  } else {
+    fprintf(stderr, "%s: %-10s %10s %12s %14s %12.3f\n", cconv_progname,
+	    "total", "", "", "", total / 1e6);
+  }
+}
+
+/*--- Producer counting what passes through */
+typedef struct {
+  Producer child;
+  void *closure;
+  Stage *stage;
+} Meter;
+
+static int meter_get(void *closure, char **data, int size)
+{
+  Meter *this = closure;
+  long long t = stats_now();
+  int num = this->child(this->closure, data, size);
+  this->stage->ns += stats_now() - t;
+  stats_count(this->stage, num);
+  return num;
+}
+
+/*--- Meter the stage just added to the chain, if keeping statistics */
+static void meter(Stats *stats, const char *name, int unit,
+		  Producer *p_prod, void **p_stream)
+{
+  Meter *this;
+  if (stats == NULL) return;
+  this = NEW(Meter);
+  this->child = *p_prod;
+  this->closure = *p_stream;
+  this->stage = stats_stage(stats, name, unit);
+  *p_prod = meter_get;
+  *p_stream = this;
+}
+
+/*-----------------------------------------------------------------------
+ *	Raw data producer from file
+ *	For raw input from a regular file, the whole file is mapped into
+ *	memory and blocks are handed out directly from the mapping.  As a
+ *	block need only last until the next call, pages before it are
+ *	given back every FILE_DROP bytes, so that resident memory stays
+ *	bounded however big the file.
+ *	Pipes, stdin and text input use buffered reads.
+ *-----------------------------------------------------------------------*/
+#define FILE_DROP (16*1024*1024)
+
+typedef struct {
+  const char *filename;
+  FILE *f;
+  int eof;
+  char *map;				/* NULL if not mapped */
+  size_t maplen;
+  size_t mappos;
+  size_t dropped;			/* Mapping before this given back */
+  char *buffer;				/* Reused for each read */
+  int bufsize;
+} FileStream;
+
+static char *file_buffer(FileStream *this, int size)
+{
+  if (size > this->bufsize) {
+    release(this->buffer);
+    this->buffer = new(this->bufsize = size);
+  }
+  return this->buffer;
+}
+
+static void file_map(FileStream *this)
+{
+  struct stat st;
+  void *map;
+  if (fstat(fileno(this->f), &st) != 0 ||
+      !S_ISREG(st.st_mode) || st.st_size == 0 ||
+      (off_t)(size_t)st.st_size != st.st_size) {
+    return;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(this->f), 0);
+  if (map == MAP_FAILED) return;
+#ifdef MADV_SEQUENTIAL
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+  madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+  this->map = map;
+  this->maplen = st.st_size;
+  this->mappos = 0;
+  this->dropped = 0;
+}
+
+/*--- Give back the pages of the mapping before mappos */
+static void file_drop(FileStream *this)
+{
+#ifdef MADV_DONTNEED
+  size_t end = this->mappos & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+  if (end < this->dropped + FILE_DROP) return;
+  madvise(this->map + this->dropped, end - this->dropped, MADV_DONTNEED);
+  this->dropped = end;
+#endif
+}
+
+static void *file_create(const char *filename, int raw)
+{
+  FileStream *this = NEW(FileStream);
+  this->filename = strcpy(new(strlen(filename)+1), filename);
+  if (strcmp(filename, "-") == 0) {
+    this->f = stdin;
+  } else {
+    this->f = fopen(filename, "rb");
+    if (this->f == NULL) {
+      fail("Cannot open %s for read", filename);
+    }
+  }
+  this->eof = FALSE;
+  this->map = NULL;
+  this->buffer = NULL;
+  this->bufsize = 0;
+  if (raw) {
+    file_map(this);
+  }
+  return this;
+}
+
+/*--- Start skip bytes in: within the map, by seeking, or else reading */
+static void file_skip(FileStream *this, long skip)
+{
+  char buf[65536];
+  size_t num;
+
+  if (skip <= 0) return;
+  if (this->map) {
+    this->mappos = (size_t)skip < this->maplen ? (size_t)skip : this->maplen;
+    return;
+  }
+  if (fseeko(this->f, skip, SEEK_CUR) == 0) return;
+  while (skip > 0) {
+    num = fread(buf, 1, skip < (long)sizeof(buf) ? skip : sizeof(buf), this->f);
+    if (num == 0) break;
+    skip -= num;
+  }
+}
+
+static void file_close(FileStream *this)
+{
+  if (this->map != NULL) munmap(this->map, this->maplen);
+  if (this->f != stdin) fclose(this->f);
+  release(this->buffer);
+}
+
+/*--- One whole line, which may be longer than size */
+static int file_get(void *closure, char **data, int size)
+{
+  FileStream *this = closure;
+  char *buf, *bigger;
+  int len;
+  if (this->eof) return -1;
+  buf = file_buffer(this, size);
+  if (fgets(buf, this->bufsize, this->f) == NULL) {
+    this->eof = TRUE;
+    return -1;
+  }
+  len = strlen(buf);
+  while (len == this->bufsize - 1 && buf[len-1] != '\n') {
+    bigger = new(this->bufsize * 2);
+    memcpy(bigger, buf, len);
+    release(buf);
+    this->buffer = buf = bigger;
+    this->bufsize *= 2;
+    if (fgets(buf + len, this->bufsize - len, this->f) == NULL) break;
+    len += strlen(buf + len);
+  }
+  *data = buf;
+  return len;
+}
+
+static int file_get_raw(void *closure, char **data, int size)
+{
+  FileStream *this = closure;
+  char *buf;
+  int nread;
+  if (this->eof) return -1;
+  if (this->map) {
+    if (this->mappos >= this->maplen) {
+      this->eof = TRUE;
+      return -1;
+    }
+    file_drop(this);
+    if (size > this->maplen - this->mappos) {
+      size = this->maplen - this->mappos;
+    }
+    *data = this->map + this->mappos;
+    this->mappos += size;
+    return size;
+  }
+  buf = file_buffer(this, size);
+  nread = fread(buf, 1, size, this->f);
+  if (nread <= 0) {
+    this->eof = TRUE;
+    return -1;
+  } else {
+    *data = buf;
+    return nread;
+  }
+}
+
+/*-----------------------------------------------------------------------
+ *	String producer from argv.
+ *	May return more than asked for.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  int argc;
+  char **argv;
+} ArgvStream;
+
+static void *argv_create(int argc, char **argv)
+{
+  ArgvStream *this = NEW(ArgvStream);
+  this->argc = argc;
+  this->argv = argv;
+  return this;
+}
+
+static int argv_get(void *closure, char **data, int size)
+{
+  ArgvStream *this = closure;
+  if (this->argc <= 0) {
+    return -1;
+  }
+  this->argc--;
+  *data = *(this->argv)++;
+  return strlen(*data);
+}
+
+/*-----------------------------------------------------------------------
+ *	Size reducer stream
+ *	Child producer may give more than we want; make sure we don't
+ *	return more than wanted to caller.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  Producer child;
+  void *closure;
+  char *last;
+  int size;
+  int offset;
+} Reducer;
+
+static void *reducer_create(Producer child, void *closure)
+{
+  Reducer *this = NEW(Reducer);
+  this->child = child;
+  this->closure = closure;
+  this->last = NULL;
+  this->size = 0;
+  this->offset = 0;
+  return this;
+}
+
+static int reducer_get(void *closure, char **data, int size)
+{
+  Reducer *this = closure;
+  int num;
+  while (this->offset >= this->size) {
+    if (this->size == -1) return -1;
+    this->size = this->child(this->closure, &this->last, 65536);
+    this->offset = 0;
+  }
+  *data = this->last + this->offset;
+  num = this->size - this->offset;
+  if (num > size) num = size;
+  this->offset += num;
+  return num;
+}
+
+/*-----------------------------------------------------------------------
+ *	Data expander
+ *	Ensure you always get a whole number of elements of the given unit
+ *	size, at least one and no more than asked for.  A partial element
+ *	left at the end of a child block is carried over to the next call;
+ *	a partial element at end of data is padded with zeros, or returned
+ *	as it is if pad is false.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  Producer child;
+  void *closure;
+  int unit;
+  int pad;
+  char *buffer;
+  int carry;
+} Expander;
+
+static void *expander_create(int unit, int pad, Producer child, void *closure)
+{
+  Expander *this = NEW(Expander);
+  this->child = child;
+  this->closure = closure;
+  this->unit = unit;
+  this->pad = pad;
+  this->buffer = new(unit);
+  this->carry = 0;
+  return this;
+}
+
+static int expander_get(void *closure, char **data, int size)
+{
+  Expander *this = closure;
+  int unit = this->unit;
+  int done, num, tail;
+  char *in;
+
+  if (size < unit) size = unit;
+  if (this->carry > 0) {
+    /*--- Complete the element left over from last time */
+    done = this->carry;
+    this->carry = 0;
+  } else {
+    num = this->child(this->closure, &in, size);
+    if (num < 0) return -1;
+    if (num >= unit) {
+      tail = num % unit;
+      if (tail > 0) {
+	memcpy(this->buffer, in + num - tail, tail);
+	this->carry = tail;
+      }
+      *data = in;
+      return num - tail;
+    }
+    memcpy(this->buffer, in, num);
+    done = num;
+  }
+  while (done < unit) {
+    num = this->child(this->closure, &in, unit-done);
+    if (num < 0 && !this->pad) {
+      *data = this->buffer;
+      return done;
+    } else if (num < 0) {
+      memset(this->buffer + done, 0, unit-done);
+      done = unit;
+    } else {
+      memcpy(this->buffer + done, in, num);
+      done += num;
+    }
+  }
+  *data = this->buffer;
+  return unit;
+}
+
+/*-----------------------------------------------------------------------
+ *	Block byte-swap kernels
+ *	Reverse the bytes of each of n units of the given width from in to
+ *	out, which may be the same.  On x86-64 the SSSE3 or AVX2 byte
+ *	shuffle is used if the CPU has it, chosen on first call by
+ *	pthread_once so that threads may call at once.
+ *-----------------------------------------------------------------------*/
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__sunos5__)
+# define HAVE_SWAP_SIMD 1
+# include <immintrin.h>
+#endif
+
+typedef void (*SwapKernel)(char *, const char *, int, int);
+
+static void swap_scalar(char *out, const char *in, int n, int width)
+{
+  uint16_t v16;
+  uint32_t v32;
+  uint64_t v64;
+  int i;
+  switch (width) {
+  case 2:
+    for (i = 0; i < n; i++, in += 2, out += 2) {
+      memcpy(&v16, in, 2);
+      v16 = bswap16(v16);
+      memcpy(out, &v16, 2);
+    }
+    break;
+  case 4:
+    for (i = 0; i < n; i++, in += 4, out += 4) {
+      memcpy(&v32, in, 4);
+      v32 = bswap32(v32);
+      memcpy(out, &v32, 4);
+    }
+    break;
+  case 8:
+    for (i = 0; i < n; i++, in += 8, out += 8) {
+      memcpy(&v64, in, 8);
+      v64 = bswap64(v64);
+      memcpy(out, &v64, 8);
+    }
+    break;
+  default:
+    if (out != in) memmove(out, in, n * width);
+  }
+}
+
+#if HAVE_SWAP_SIMD
+/*--- Shuffle control reversing each unit within 16 bytes */
+static __m128i swap_mask(int width)
+{
+  char m[16];
+  int i;
+  for (i = 0; i < 16; i++) {
+    m[i] = (i / width) * width + (width - 1 - i % width);
+  }
+  return _mm_loadu_si128((const __m128i *)m);
+}
+
+__attribute__((target("ssse3")))
+static void swap_ssse3(char *out, const char *in, int n, int width)
+{
+  __m128i mask, v;
+  int i, bytes = n * width;
+  if (width != 2 && width != 4 && width != 8) {
+    swap_scalar(out, in, n, width);
+    return;
+  }
+  mask = swap_mask(width);
+  for (i = 0; i + 16 <= bytes; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(in + i));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(v, mask));
+  }
+  swap_scalar(out + i, in + i, (bytes - i) / width, width);
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2(char *out, const char *in, int n, int width)
+{
+  __m256i mask, v;
+  int i, bytes = n * width;
+  if (width != 2 && width != 4 && width != 8) {
+    swap_scalar(out, in, n, width);
+    return;
+  }
+  mask = _mm256_broadcastsi128_si256(swap_mask(width));
+  for (i = 0; i + 32 <= bytes; i += 32) {
+    v = _mm256_loadu_si256((const __m256i *)(in + i));
+    _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(v, mask));
+  }
+  swap_scalar(out + i, in + i, (bytes - i) / width, width);
+}
+#endif
+
+static SwapKernel swap_kernel = swap_scalar;
+static pthread_once_t swap_once = PTHREAD_ONCE_INIT;
+
+/*--- Best kernel for this CPU, once for all threads */
+static void swap_choose(void)
+{
+#if HAVE_SWAP_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    swap_kernel = swap_avx2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    swap_kernel = swap_ssse3;
+  }
+#endif
+}
+
+static void swap_block(char *out, const char *in, int n, int width)
+{
+  pthread_once(&swap_once, swap_choose);
+  swap_kernel(out, in, n, width);
+}
+
+/*-----------------------------------------------------------------------
+ *	Byte swapper
+ *	Swaps each block from the child, which must hold whole units.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  Producer child;
+  void *closure;
+  int width;
+  char *buffer;
+  int bufsize;
+} Swapper;
+
+static void *swapper_create(int width, Producer child, void *closure)
+{
+  Swapper *this = NEW(Swapper);
+  this->child = child;
+  this->closure = closure;
+  this->width = width;
+  this->buffer = NULL;
+  this->bufsize = 0;
+  return this;
+}
+
+static int swapper_get(void *closure, char **data, int size)
+{
+  Swapper *this = closure;
+  int num, n;
+  char *in;
+
+  num = this->child(this->closure, &in, size);
+  if (num < 0) return -1;
+  if (num > this->bufsize) {
+    release(this->buffer);
+    this->buffer = new(this->bufsize = num);
+  }
+  n = num / this->width;
+  swap_block(this->buffer, in, n, this->width);
+  memcpy(this->buffer + n * this->width, in + n * this->width,
+	 num - n * this->width);
+  *data = this->buffer;
+  return num;
+}
+
+/*-----------------------------------------------------------------------
+ *	Binary to binary type conversion
+ *	Raw input of one numeric type is converted directly to a different
+ *	numeric output type, raw or to be formatted, though integers
+ *	differing only in signedness are passed on as they are.  Integers
+ *	saturate at the limits of the output type unless conv->wrap, when
+ *	they keep their low bits as in C; floating values become integers
+ *	by rounding to nearest (ties to even), or toward zero if
+ *	conv->truncate, then saturate, with NaN as 0.  Common widening and
+ *	narrowing pairs use SSE2 on x86-64.
+ *-----------------------------------------------------------------------*/
+typedef void (*RetypeKernel)(char *, const char *, int, const Conversion *);
+
+#define RETYPE_IS_FLOAT(t) ((t)0.5 != 0)
+#define RETYPE_IS_SIGNED(t) ((t)-1 < 0)
+#define RETYPE_2_52 4503599627370496.0	/* Doubles this big are whole */
+
+/*--- Whole number nearest x, or toward zero */
+static double retype_round(double x, int truncate)
+{
+  if (!(x < RETYPE_2_52 && x > -RETYPE_2_52)) return x;	/* Or NaN */
+  if (truncate) return (double)(long long)x;
+  if (x < 0) return -((-x + RETYPE_2_52) - RETYPE_2_52);
+  return (x + RETYPE_2_52) - RETYPE_2_52;
+}
+
+/*--- The kernel from C type "from" to "to", whose limits are lo and hi */
+#define RETYPE(from, fname, to, tname, lo, hi)				\
+static void retype_##fname##_##tname(char *out, const char *in, int n,	\
+				     const Conversion *conv)		\
+{									\
+  const from *s = (const from *)in;					\
+  to *d = (to *)out;							\
+  double x;								\
+  int i;								\
+  if (RETYPE_IS_FLOAT(to) || (conv->wrap && !RETYPE_IS_FLOAT(from))) {	\
+    for (i = 0; i < n; i++) d[i] = (to)s[i];				\
+  } else if (RETYPE_IS_FLOAT(from)) {					\
+    for (i = 0; i < n; i++) {						\
+      x = retype_round(s[i], conv->truncate);				\
+      d[i] = x != x ? 0 : x < (double)(lo) ? (to)(lo) :			\
+	x >= ((double)((hi) / 2 + 1)) * 2 ? (to)(hi) : (to)x;		\
+    }									\
+  } else if (RETYPE_IS_SIGNED(from)) {					\
+    for (i = 0; i < n; i++) {						\
+      d[i] = (long long)s[i] < (long long)(lo) ? (to)(lo) :		\
+	s[i] > 0 && (unsigned long long)s[i] > (hi) ? (to)(hi) : (to)s[i]; \
+    }									\
+  } else {								\
+    for (i = 0; i < n; i++) {						\
+      d[i] = (unsigned long long)s[i] > (hi) ? (to)(hi) : (to)s[i];	\
+    }									\
+  }									\
+}
+
+#define RETYPE_NAME(from, fname, to, tname, lo, hi) retype_##fname##_##tname,
+
+/*--- X(from, fname, ...) for each numeric type, in RetypeKind order */
+#define RETYPE_TO(X, from, fname)					\
+  X(from, fname, signed char, char, SCHAR_MIN, SCHAR_MAX)		\
+  X(from, fname, unsigned char, uchar, 0, UCHAR_MAX)			\
+  X(from, fname, short, short, SHRT_MIN, SHRT_MAX)			\
+  X(from, fname, unsigned short, ushort, 0, USHRT_MAX)			\
+  X(from, fname, int, int, INT_MIN, INT_MAX)				\
+  X(from, fname, unsigned int, uint, 0, UINT_MAX)			\
+  X(from, fname, long, long, LONG_MIN, LONG_MAX)			\
+  X(from, fname, unsigned long, ulong, 0, ULONG_MAX)			\
+  X(from, fname, float, float, 0, 0)					\
+  X(from, fname, double, double, 0, 0)
+
+#define RETYPE_ALL(X)							\
+  RETYPE_TO(X, signed char, char)					\
+  RETYPE_TO(X, unsigned char, uchar)					\
+  RETYPE_TO(X, short, short)						\
+  RETYPE_TO(X, unsigned short, ushort)					\
+  RETYPE_TO(X, int, int)						\
+  RETYPE_TO(X, unsigned int, uint)					\
+  RETYPE_TO(X, long, long)						\
+  RETYPE_TO(X, unsigned long, ulong)					\
+  RETYPE_TO(X, float, float)						\
+  RETYPE_TO(X, double, double)
+
+RETYPE_ALL(RETYPE)
+
+enum RetypeKind {
+  RETYPE_CHAR, RETYPE_UCHAR, RETYPE_SHORT, RETYPE_USHORT, RETYPE_INT,
+  RETYPE_UINT, RETYPE_LONG, RETYPE_ULONG, RETYPE_FLOAT, RETYPE_DOUBLE,
+  RETYPE_KINDS
+};
+
+static const RetypeKernel retype_kernels[RETYPE_KINDS * RETYPE_KINDS] = {
+  RETYPE_ALL(RETYPE_NAME)
+};
+
+#if HAVE_SWAP_SIMD
+/*--- SSE2, part of x86-64, so no need to check the CPU */
+static void retype_sse_short_float(char *out, const char *in, int n,
+				   const Conversion *conv)
+{
+  __m128i v;
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2*i));
+    _mm_storeu_ps((float *)out + i,
+		  _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+    _mm_storeu_ps((float *)out + i + 4,
+		  _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)));
+  }
+  retype_short_float(out + 4*i, in + 2*i, n - i, conv);
+}
+
+static void retype_sse_ushort_float(char *out, const char *in, int n,
+				    const Conversion *conv)
+{
+  __m128i v, zero = _mm_setzero_si128();
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2*i));
+    _mm_storeu_ps((float *)out + i,
+		  _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+    _mm_storeu_ps((float *)out + i + 4,
+		  _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+  }
+  retype_ushort_float(out + 4*i, in + 2*i, n - i, conv);
+}
+
+static void retype_sse_int_float(char *out, const char *in, int n,
+				 const Conversion *conv)
+{
+  int i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    _mm_storeu_ps((float *)out + i,
+		  _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(in + 4*i))));
+  }
+  retype_int_float(out + 4*i, in + 4*i, n - i, conv);
+}
+
+static void retype_sse_int_double(char *out, const char *in, int n,
+				  const Conversion *conv)
+{
+  __m128i v;
+  int i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm_loadu_si128((const __m128i *)(in + 4*i));
+    _mm_storeu_pd((double *)out + i, _mm_cvtepi32_pd(v));
+    _mm_storeu_pd((double *)out + i + 2,
+		  _mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)));
+  }
+  retype_int_double(out + 8*i, in + 4*i, n - i, conv);
+}
+
+static void retype_sse_float_double(char *out, const char *in, int n,
+				    const Conversion *conv)
+{
+  __m128 v;
+  int i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    v = _mm_loadu_ps((const float *)in + i);
+    _mm_storeu_pd((double *)out + i, _mm_cvtps_pd(v));
+    _mm_storeu_pd((double *)out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+  }
+  retype_float_double(out + 8*i, in + 4*i, n - i, conv);
+}
+
+static void retype_sse_double_float(char *out, const char *in, int n,
+				    const Conversion *conv)
+{
+  __m128 lo, hi;
+  int i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    lo = _mm_cvtpd_ps(_mm_loadu_pd((const double *)in + i));
+    hi = _mm_cvtpd_ps(_mm_loadu_pd((const double *)in + i + 2));
+    _mm_storeu_ps((float *)out + i, _mm_movelh_ps(lo, hi));
+  }
+  retype_double_float(out + 4*i, in + 8*i, n - i, conv);
+}
+
+/*--- Four floats to saturated ints: NaN is 0, 2^31 and above INT_MAX */
+static __m128i retype_sse_float_ints(__m128 v, int truncate)
+{
+  __m128i big;
+  v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+  big = _mm_castps_si128(_mm_cmpge_ps(v, _mm_set1_ps(2147483648.0f)));
+  return _mm_xor_si128(truncate ? _mm_cvttps_epi32(v) : _mm_cvtps_epi32(v),
+		       big);
+}
+
+static void retype_sse_float_int(char *out, const char *in, int n,
+				 const Conversion *conv)
+{
+  int i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    _mm_storeu_si128((__m128i *)(out + 4*i),
+		     retype_sse_float_ints(_mm_loadu_ps((const float *)in + i),
+					   conv->truncate));
+  }
+  retype_float_int(out + 4*i, in + 4*i, n - i, conv);
+}
+
+static void retype_sse_float_short(char *out, const char *in, int n,
+				   const Conversion *conv)
+{
+  __m128i lo, hi;
+  int i;
+  for (i = 0; i + 8 <= n; i += 8) {
+    lo = retype_sse_float_ints(_mm_loadu_ps((const float *)in + i),
+			       conv->truncate);
+    hi = retype_sse_float_ints(_mm_loadu_ps((const float *)in + i + 4),
+			       conv->truncate);
+    _mm_storeu_si128((__m128i *)(out + 2*i), _mm_packs_epi32(lo, hi));
+  }
+  retype_float_short(out + 2*i, in + 4*i, n - i, conv);
+}
+#endif
+
+static int retype_kind(const Conversion *conv)
+{
+  int u = conv->unsignedp ? 1 : 0;
+  switch (conv->type) {
+  case TYPE_CHAR:	return RETYPE_CHAR + u;
+  case TYPE_SHORT:	return RETYPE_SHORT + u;
+  case TYPE_INT:	return RETYPE_INT + u;
+  case TYPE_LONG:	return RETYPE_LONG + u;
+  case TYPE_FLOAT:	return RETYPE_FLOAT;
+  case TYPE_DOUBLE:	return RETYPE_DOUBLE;
+  default:		return -1;
+  }
+}
+
+/*--- Kernel from inconv's type to outconv's, NULL if none needed: also
+ * between integers differing only in signedness, whose bits are kept */
+static RetypeKernel retype_kernel(const Conversion *inconv,
+				  const Conversion *outconv)
+{
+  int from = retype_kind(inconv), to = retype_kind(outconv);
+  if (from < 0 || to < 0 || from == to) return NULL;
+  if (from < RETYPE_FLOAT && from / 2 == to / 2) return NULL;
+#if HAVE_SWAP_SIMD
+  switch (from * RETYPE_KINDS + to) {
+  case RETYPE_SHORT * RETYPE_KINDS + RETYPE_FLOAT:
+    return retype_sse_short_float;
+  case RETYPE_USHORT * RETYPE_KINDS + RETYPE_FLOAT:
+    return retype_sse_ushort_float;
+  case RETYPE_INT * RETYPE_KINDS + RETYPE_FLOAT:
+    return retype_sse_int_float;
+  case RETYPE_INT * RETYPE_KINDS + RETYPE_DOUBLE:
+    return retype_sse_int_double;
+  case RETYPE_FLOAT * RETYPE_KINDS + RETYPE_DOUBLE:
+    return retype_sse_float_double;
+  case RETYPE_DOUBLE * RETYPE_KINDS + RETYPE_FLOAT:
+    return retype_sse_double_float;
+  case RETYPE_FLOAT * RETYPE_KINDS + RETYPE_INT:
+    return retype_sse_float_int;
+  case RETYPE_FLOAT * RETYPE_KINDS + RETYPE_SHORT:
+    return retype_sse_float_short;
+  }
+#endif
+  return retype_kernels[from * RETYPE_KINDS + to];
+}
+
+/*--- Stream of whole values converted by kernel */
+typedef struct {
+  Producer child;
+  void *closure;
+  RetypeKernel kernel;
+  const Conversion *conv;
+  int inunit, outunit;
+  char *buffer;
+  int bufsize;
+} Retyper;
+
+static void *retyper_create(RetypeKernel kernel, const Conversion *inconv,
+			    const Conversion *outconv, Producer child,
+			    void *closure)
+{
+  Retyper *this = NEW(Retyper);
+  this->child = child;
+  this->closure = closure;
+  this->kernel = kernel;
+  this->conv = outconv;
+  this->inunit = conversion_size(inconv);
+  this->outunit = conversion_size(outconv);
+  this->buffer = NULL;
+  this->bufsize = 0;
+  return this;
+}
+
+static int retyper_get(void *closure, char **data, int size)
+{
+  Retyper *this = closure;
+  int num, n;
+  char *in;
+
+  n = size / this->outunit;
+  if (n < 1) n = 1;
+  num = this->child(this->closure, &in, n * this->inunit);
+  if (num < 0) return -1;
+  n = num / this->inunit;
+  if (n * this->outunit > this->bufsize) {
+    release(this->buffer);
+    this->buffer = new(this->bufsize = n * this->outunit);
+  }
+  this->kernel(this->buffer, in, n, this->conv);
+  *data = this->buffer;
+  return n * this->outunit;
+}
+
+/*-----------------------------------------------------------------------
+ *	Calibration
+ *	Value i becomes x * scale[c] + offset[c] for channel c = i % nchannel
+ *	of interleaved data, of the output type.  Values are converted to
+ *	double with the retype kernels, calibrated by a fused multiply-add
+ *	with scale and offset as given, and converted on to the output type
+ *	by the rules of retyping, so float output is the double result
+ *	rounded once.  Common pairs are done in one pass with AVX2 and FMA
+ *	if the CPU has them; as fma() rounds once just as those do, the
+ *	results are the same either way.
+ *	Tables repeat the channels for 8 more entries, so that a vector
+ *	of scales starting at any channel can be loaded at once.
+ *-----------------------------------------------------------------------*/
+typedef struct Calibrator Calibrator;
+typedef int (*CalibrateKernel)(char *, const char *, int, Calibrator *);
+
+struct Calibrator {
+  Producer child;
+  void *closure;
+  const Conversion *conv;
+  RetypeKernel to_work, from_work;	/* Input to work type to output */
+  CalibrateKernel fused;		/* Or NULL */
+  int inunit, outunit;
+  int nchannel;
+  int channel;				/* Of next value */
+  double *scale, *offset;
+  char *work;
+  char *buffer;
+};
+
+#if HAVE_SWAP_SIMD
+/*--- Four doubles x calibrated from channel c, rounded to floats */
+__attribute__((target("avx2,fma")))
+static __m128 calibrate_floats(__m256d x, Calibrator *this, int c)
+{
+  return _mm256_cvtpd_ps(_mm256_fmadd_pd(x, _mm256_loadu_pd(this->scale + c),
+					 _mm256_loadu_pd(this->offset + c)));
+}
+
+__attribute__((target("avx2,fma")))
+static int calibrate_short_float(char *out, const char *in, int n,
+				 Calibrator *this)
+{
+  int i, c = this->channel, nc = this->nchannel;
+  __m128i v;
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2*i));
+    _mm_storeu_ps((float *)out + i, calibrate_floats(
+		    _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(v)), this, c));
+    _mm_storeu_ps((float *)out + i + 4, calibrate_floats(
+		    _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(
+		      _mm_unpackhi_epi64(v, v))), this, c + 4));
+    c = (c + 8) % nc;
+  }
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int calibrate_ushort_float(char *out, const char *in, int n,
+				  Calibrator *this)
+{
+  int i, c = this->channel, nc = this->nchannel;
+  __m128i v;
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm_loadu_si128((const __m128i *)(in + 2*i));
+    _mm_storeu_ps((float *)out + i, calibrate_floats(
+		    _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(v)), this, c));
+    _mm_storeu_ps((float *)out + i + 4, calibrate_floats(
+		    _mm256_cvtepi32_pd(_mm_cvtepu16_epi32(
+		      _mm_unpackhi_epi64(v, v))), this, c + 4));
+    c = (c + 8) % nc;
+  }
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int calibrate_float_float(char *out, const char *in, int n,
+				 Calibrator *this)
+{
+  int i, c = this->channel, nc = this->nchannel;
+  for (i = 0; i + 4 <= n; i += 4) {
+    _mm_storeu_ps((float *)out + i, calibrate_floats(
+		    _mm256_cvtps_pd(_mm_loadu_ps((const float *)in + i)),
+		    this, c));
+    c = (c + 4) % nc;
+  }
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int calibrate_short_double(char *out, const char *in, int n,
+				  Calibrator *this)
+{
+  int i, c = this->channel, nc = this->nchannel;
+  __m256d x;
+  for (i = 0; i + 4 <= n; i += 4) {
+    x = _mm256_cvtepi32_pd(_mm_cvtepi16_epi32(
+	  _mm_loadl_epi64((const __m128i *)(in + 2*i))));
+    _mm256_storeu_pd((double *)out + i,
+		     _mm256_fmadd_pd(x, _mm256_loadu_pd(this->scale + c),
+				     _mm256_loadu_pd(this->offset + c)));
+    c = (c + 4) % nc;
+  }
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int calibrate_int_double(char *out, const char *in, int n,
+				Calibrator *this)
+{
+  int i, c = this->channel, nc = this->nchannel;
+  __m256d x;
+  for (i = 0; i + 4 <= n; i += 4) {
+    x = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(in + 4*i)));
+    _mm256_storeu_pd((double *)out + i,
+		     _mm256_fmadd_pd(x, _mm256_loadu_pd(this->scale + c),
+				     _mm256_loadu_pd(this->offset + c)));
+    c = (c + 4) % nc;
+  }
+  return i;
+}
+#endif
+
+static CalibrateKernel calibrate_kernel(int from, int to)
+{
+#if HAVE_SWAP_SIMD
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+    return NULL;
+  }
+  switch (from * RETYPE_KINDS + to) {
+  case RETYPE_SHORT * RETYPE_KINDS + RETYPE_FLOAT:
+    return calibrate_short_float;
+  case RETYPE_USHORT * RETYPE_KINDS + RETYPE_FLOAT:
+    return calibrate_ushort_float;
+  case RETYPE_FLOAT * RETYPE_KINDS + RETYPE_FLOAT:
+    return calibrate_float_float;
+  case RETYPE_SHORT * RETYPE_KINDS + RETYPE_DOUBLE:
+    return calibrate_short_double;
+  case RETYPE_INT * RETYPE_KINDS + RETYPE_DOUBLE:
+    return calibrate_int_double;
+  }
+#endif
+  return NULL;
+}
+
+static void *calibrator_create(const Conversion *inconv,
+			       const Conversion *outconv,
+			       const CconvOptions *opt, Producer child,
+			       void *closure)
+{
+  Calibrator *this = NEW(Calibrator);
+  int from = retype_kind(inconv), to = retype_kind(outconv);
+  int nc = opt->nchannel;
+  int i;
+
+  if (from < 0 || to < 0) {
+    fail("--scale and --offset need numeric types");
+  }
+  this->child = child;
+  this->closure = closure;
+  this->conv = outconv;
+  this->to_work = retype_kernels[from * RETYPE_KINDS + RETYPE_DOUBLE];
+  this->from_work = retype_kernels[RETYPE_DOUBLE * RETYPE_KINDS + to];
+  this->fused = calibrate_kernel(from, to);
+  this->inunit = conversion_size(inconv);
+  this->outunit = conversion_size(outconv);
+  this->nchannel = nc;
+  this->channel = 0;
+  this->scale = new((nc + 8) * sizeof(double));
+  this->offset = new((nc + 8) * sizeof(double));
+  for (i = 0; i < nc + 8; i++) {
+    this->scale[i] = opt->scale ? opt->scale[i % nc] : 1.0;
+    this->offset[i] = opt->offset ? opt->offset[i % nc] : 0.0;
+  }
+  this->work = new(BLOCK_VALUES * sizeof(double));
+  this->buffer = new(BLOCK_VALUES * this->outunit);
+  return this;
+}
+
+/*--- Whole values from the child, calibrated */
+static int calibrator_get(void *closure, char **data, int size)
+{
+  Calibrator *this = closure;
+  int nc = this->nchannel;
+  int num, n, i, c, done = 0;
+  double *d;
+  char *in;
+
+  n = size / this->outunit;
+  if (n < 1) n = 1;
+  if (n > BLOCK_VALUES) n = BLOCK_VALUES;
+  num = this->child(this->closure, &in, n * this->inunit);
+  if (num < 0) return -1;
+  n = num / this->inunit;
+
+  if (this->fused) {
+    done = this->fused(this->buffer, in, n, this);
+    this->channel = (this->channel + done) % nc;
+    in += done * this->inunit;
+  }
+  this->to_work(this->work, in, n - done, this->conv);
+  c = this->channel;
+  for (d = (double *)this->work, i = 0; i < n - done; i++) {
+    d[i] = fma(d[i], this->scale[c], this->offset[c]);
+    if (++c == nc) c = 0;
+  }
+  this->channel = c;
+  this->from_work(this->buffer + done * this->outunit, this->work, n - done,
+		  this->conv);
+  *data = this->buffer;
+  return n * this->outunit;
+}
+
+/*-----------------------------------------------------------------------
+ *	Value selector
+ *	Hands on value first, then every stride-th value after it, up to
+ *	count values.  Only those are copied, and the child is asked for
+ *	no more than is needed to reach them, so from a mapped file the
+ *	values passed over are never read.  The child must produce whole
+ *	values.
+ *-----------------------------------------------------------------------*/
+#define SELECT_CHUNK (1L << 24)		/* Most asked of child at once */
+
+typedef struct {
+  Producer child;
+  void *closure;
+  int unit;
+  int stride;
+  long gap;				/* Bytes to pass before next value */
+  long left;				/* Values still to go, -1: no limit */
+  char *buffer;
+} Selector;
+
+static void *selector_create(int unit, const CconvOptions *opt,
+			     Producer child, void *closure)
+{
+  Selector *this = NEW(Selector);
+  if (unit == 0) {
+    fail("--stride, --channel and --count need values of fixed size");
+  }
+  this->child = child;
+  this->closure = closure;
+  this->unit = unit;
+  this->stride = opt->stride > 1 ? opt->stride : 1;
+  this->gap = (long)opt->first * unit;
+  this->left = opt->count > 0 ? opt->count : -1;
+  this->buffer = new(BLOCK_VALUES * unit);
+  return this;
+}
+
+static int selector_get(void *closure, char **data, int size)
+{
+  Selector *this = closure;
+  int unit = this->unit;
+  long step = (long)this->stride * unit;
+  long want, off;
+  int n, num, got = 0;
+  char *in;
+
+  n = size / unit;
+  if (n < 1) n = 1;
+  if (n > BLOCK_VALUES) n = BLOCK_VALUES;
+  if (this->left >= 0 && n > this->left) n = this->left;
+  if (n == 0) return -1;
+
+  if (step == unit && this->gap == 0) {
+    /*--- Consecutive values: hand on the child's data as it is */
+    num = this->child(this->closure, data, n * unit);
+    num -= num % unit;			/* Not a part value at the end */
+    if (num <= 0) return -1;
+    if (this->left >= 0) this->left -= num / unit;
+    return num;
+  }
+  while (got < n) {
+    /*--- Up to the end of the last value wanted, in whole values */
+    want = this->gap + (n - got - 1) * step + unit;
+    if (want > SELECT_CHUNK) want = SELECT_CHUNK - SELECT_CHUNK % unit;
+    num = this->child(this->closure, &in, (int)want);
+    if (num < 0) break;
+    for (off = this->gap; off + unit <= num && got < n; off += step) {
+      memcpy(this->buffer + got * unit, in + off, unit);
+      got++;
+    }
+    this->gap = off - num;
+  }
+  if (got == 0) return -1;
+  if (this->left >= 0) this->left -= got;
+  *data = this->buffer;
+  return got * unit;
+}
+
+/*--- Whether opt selects values */
+static int selecting(const CconvOptions *opt)
+{
+  return opt->first > 0 || opt->stride > 1 || opt->count > 0;
+}
+
+/*--- Put a selector in the chain, if values are to be selected */
+static void selector_add(const CconvOptions *opt, int unit, Stats *stats,
+			 Producer *p_prod, void **p_stream)
+{
+  if (!selecting(opt)) return;
+  *p_stream = selector_create(unit, opt, *p_prod, *p_stream);
+  *p_prod = selector_get;
+  meter(stats, "select", unit, p_prod, p_stream);
+}
+
+/*-----------------------------------------------------------------------
+ *	Value splitter stream
+ *	Splits each string (line) from the child at spaces, tabs, commas
+ *	and line ends, handing out one value at a time as a pointer into
+ *	the child's data, so nothing is copied.  Runs of spaces and tabs
+ *	are one separator, but each comma separates two fields, neither of
+ *	which may be empty: "5,,6", ",5" and "5," fail rather than shift
+ *	the columns after them.  Delimiters are found 16 bytes at a time
+ *	with SSE2 on x86-64.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  Producer child;
+  void *closure;
+  char *line;
+  char *pos, *end;			/* Rest of current line */
+  int field;				/* A value since the last comma */
+  int comma;				/* A comma since the last value */
+} Splitter;
+
+static void *splitter_create(Producer child, void *closure)
+{
+  Splitter *this = NEW(Splitter);
+  this->child = child;
+  this->closure = closure;
+  this->line = this->pos = this->end = NULL;
+  this->field = this->comma = FALSE;
+  return this;
+}
+
+static int split_space(int c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void split_empty(Splitter *this)
+{
+  int len = this->end - this->line;
+  while (len > 0 && split_space(this->line[len-1])) len--;
+  fail("Empty field in \"%.*s\"", len, this->line);
+}
+
+static int split_delim(int c)
+{
+  return c == ' ' || c == ',' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*--- First delimiter at or after p, or end */
+static char *split_scan(char *p, char *end)
+{
+#if HAVE_SWAP_SIMD
+  const __m128i space = _mm_set1_epi8(' '), comma = _mm_set1_epi8(',');
+  const __m128i tab = _mm_set1_epi8('\t'), nl = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  __m128i v, m;
+  int mask;
+  for (; end - p >= 16; p += 16) {
+    v = _mm_loadu_si128((const __m128i *)p);
+    m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space),
+				  _mm_cmpeq_epi8(v, comma)),
+		     _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab),
+					       _mm_cmpeq_epi8(v, nl)),
+				  _mm_cmpeq_epi8(v, cr)));
+    if ((mask = _mm_movemask_epi8(m)) != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (p < end && !split_delim(*p)) p++;
+  return p;
+}
+
+static int splitter_get(void *closure, char **data, int size)
+{
+  Splitter *this = closure;
+  char *str;
+  int len;
+
+  for (;;) {
+    while (this->pos < this->end && split_space(*this->pos)) this->pos++;
+    if (this->pos < this->end && *this->pos == ',') {
+      if (!this->field) split_empty(this);
+      this->field = FALSE;
+      this->comma = TRUE;
+      this->pos++;
+      continue;
+    }
+    if (this->pos < this->end) break;
+    if (this->comma) split_empty(this);	/* Comma at end of line */
+    if ((len = this->child(this->closure, &str, 1024)) < 0) return -1;
+    this->line = this->pos = str;
+    this->end = str + len;
+    this->field = this->comma = FALSE;
+  }
+  this->field = TRUE;
+  this->comma = FALSE;
+  str = this->pos;
+  this->pos = split_scan(str, this->end);
+  *data = str;
+  return this->pos - str;
+}
+
+/*-----------------------------------------------------------------------
+ *	Extended floating point: f*2^e with 64-bit significand, used for
+ *	converting between binary and decimal floating point.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+/*--- 10^(8i-348) normalised to 64 bits */
+static const uint64_t cached_power_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const short cached_power_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10_table[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static DiyFp diyfp_mul(DiyFp x, DiyFp y)
+{
+  uint64_t a = x.f >> 32, b = x.f & 0xffffffff;
+  uint64_t c = y.f >> 32, d = y.f & 0xffffffff;
+  uint64_t ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+  uint64_t tmp = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+  DiyFp r;
+  tmp += 1U << 31;			/* Round */
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static DiyFp diyfp_normalize(DiyFp x)
+{
+  while (!(x.f & (1ULL << 63))) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+/*-----------------------------------------------------------------------
+ *	Convert from text to long
+ *	Allow either signed or unsigned, as strtol falling back to strtoul
+ *	would: a magnitude beyond unsigned long gives 0, otherwise the
+ *	value wraps, e.g. "0xffffffffffffffff" and "-1" are the same.
+ *	Leading white space, a sign and (for base 16 or 0) a 0x prefix are
+ *	accepted; base 0 means C conventions.  Independent of locale.
+ *	Decimal digits are taken eight at a time where the text allows.
+ *	*rest is set to the first character not used, or str if no digits.
+ *-----------------------------------------------------------------------*/
+/*--- Value of each character as a digit, -1 if none */
+static const signed char digit_value[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  0,1,2,3,4,5,6,7,8,9,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,
+  25,26,27,28,29,30,31,32,33,34,35,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,
+  25,26,27,28,29,30,31,32,33,34,35,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+/*--- Load 8 characters with the first in the low byte */
+static uint64_t load8(const char *p)
+{
+  static const union { uint16_t v; char b[2]; } endian = { 1 };
+  uint64_t x;
+  memcpy(&x, p, 8);
+  return endian.b[0] ? x : bswap64(x);
+}
+
+static int is8digits(uint64_t x)
+{
+  return ((x & 0xf0f0f0f0f0f0f0f0ULL) |
+	  (((x + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) ==
+    0x3333333333333333ULL;
+}
+
+static uint32_t parse8digits(uint64_t x)
+{
+  x -= 0x3030303030303030ULL;
+  x = (x * 10) + (x >> 8);
+  x = (((x & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+       (((x >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+  return x;
+}
+
+static long text2long(const char *str, const char *end, const char **rest,
+		      int base)
+{
+  const unsigned char *p = (const unsigned char *)str;
+  const unsigned char *e = (const unsigned char *)end;
+  const unsigned char *digits;
+  unsigned long mag = 0, limit;
+  int neg = FALSE, over = FALSE;
+  int d;
+
+  while (p < e && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) p++;
+  if (p < e && (*p == '-' || *p == '+')) {
+    neg = (*p++ == '-');
+  }
+  if (p + 1 < e && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') &&
+      (base == 0 || base == 16) && p + 2 < e &&
+      digit_value[p[2]] >= 0 && digit_value[p[2]] < 16) {
+    p += 2;
+    base = 16;
+  } else if (base == 0) {
+    base = (p < e && *p == '0') ? 8 : 10;
+  }
+  digits = p;
+  if (base == 10) {
+    uint32_t chunk;
+    while (e - p >= 8 && is8digits(load8((const char *)p))) {
+      chunk = parse8digits(load8((const char *)p));
+      if (mag > (ULONG_MAX - chunk) / 100000000UL) over = TRUE;
+      mag = mag * 100000000UL + chunk;
+      p += 8;
+    }
+  }
+  limit = ULONG_MAX / base;
+  while (p < e && (d = digit_value[*p]) >= 0 && d < base) {
+    if (mag > limit || mag * base > ULONG_MAX - d) over = TRUE;
+    mag = mag * base + d;
+    p++;
+  }
+  if (p == digits) {
+    *rest = str;
+    return 0;
+  }
+  *rest = (const char *)p;
+  if (over) return 0;
+  return neg ? -mag : mag;
+}
+
+/*-----------------------------------------------------------------------
+ *	Convert from text to float or double
+ *	Locale-independent and correctly rounded.  Exact cases (up to 2^53
+ *	times or divided by a power of ten up to 10^22, or 2^24 and 10^10
+ *	for float) use plain floating point arithmetic.  Otherwise the
+ *	decimal significand is multiplied by a cached power of ten in
+ *	extended precision, tracking the error bound, and rounded directly
+ *	to the target format (as rapidjson's StrtodDiyFp, cf. Eisel and
+ *	Lemire).  Only when the result is too close to a rounding boundary
+ *	to decide, or for inf, nan and hex forms, does strtod/strtof do it.
+ *-----------------------------------------------------------------------*/
+static const double exact_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const float exact_pow10f[] = {
+  1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/*--- Round m*10^e10 to IEEE bits; FALSE if it cannot be decided */
+static int decimal2ieee(uint64_t m, int e10, int inexact, int mbits, int ebits,
+			uint64_t *bits)
+{
+  static const int ulp_shift = 3;
+  const int ulp = 1 << ulp_shift;
+  const int bias = (1 << (ebits-1)) - 1;
+  const int denormal = 1 - bias - mbits;	/* Exponent of subnormals */
+  const uint64_t hidden = 1ULL << mbits;
+  DiyFp v, c;
+  int64_t error = inexact ? ulp / 2 : 0;
+  uint64_t precision_bits, half_way, f;
+  int index, adjust, old_e, order, sigbits, precision, e, be;
+
+  if (e10 < -348 || e10 > 340) return FALSE;
+  v.f = m;
+  v.e = 0;
+  v = diyfp_normalize(v);
+  error <<= -v.e;
+  index = (e10 + 348) / 8;
+  adjust = e10 - (index * 8 - 348);
+  if (adjust > 0) {
+    c.f = pow10_table[adjust];		/* Exact */
+    c.e = 0;
+    v = diyfp_mul(v, diyfp_normalize(c));
+    if (m >= 10000000000000000000ULL / pow10_table[adjust] || inexact) {
+      error += ulp / 2;
+    }
+  }
+  c.f = cached_power_f[index];
+  c.e = cached_power_e[index];
+  v = diyfp_mul(v, c);
+  error += ulp + (error == 0 ? 0 : 1);
+  old_e = v.e;
+  v = diyfp_normalize(v);
+  error <<= old_e - v.e;
+
+  /*--- Bits of v.f beyond the target precision decide the rounding */
+  order = 64 + v.e;
+  if (order < denormal) {
+    /*--- Below half the smallest subnormal, unless error straddles it */
+    if (~v.f <= (uint64_t)(error >> ulp_shift) + 1) return FALSE;
+    *bits = 0;
+    return TRUE;
+  }
+  if (order >= 2 - bias) {
+    sigbits = mbits + 1;
+  } else if (order <= denormal) {
+    sigbits = 0;
+  } else {
+    sigbits = order - denormal;
+  }
+  precision = 64 - sigbits;
+  if (precision + ulp_shift >= 64) {
+    int scale = precision + ulp_shift - 63;
+    v.f >>= scale;
+    v.e += scale;
+    error = (error >> scale) + 1 + ulp;
+    precision -= scale;
+  }
+  f = v.f >> precision;
+  e = v.e + precision;
+  precision_bits = (v.f & ((1ULL << precision) - 1)) * ulp;
+  half_way = (1ULL << (precision - 1)) * ulp;
+  if (precision_bits >= half_way + (uint64_t)error) {
+    f++;
+    if (f & (hidden << 1)) {
+      f >>= 1;
+      e++;
+    }
+  }
+  if (! (half_way - (uint64_t)error >= precision_bits ||
+	 precision_bits >= half_way + (uint64_t)error)) {
+    return FALSE;
+  }
+  be = (e == denormal && !(f & hidden)) ? 0 : e + bias + mbits;
+  if (be >= (1 << ebits) - 1) {
+    *bits = (uint64_t)((1 << ebits) - 1) << mbits;	/* Infinity */
+  } else {
+    *bits = (f & (hidden - 1)) | ((uint64_t)be << mbits);
+  }
+  return TRUE;
+}
+
+/*--- Parse up to end into significand and exponent, setting rest to
+ * what follows; FALSE if not plain decimal */
+static int text2decimal(const char *str, const char *end, const char **rest,
+			int *neg, uint64_t *m, int *e10, int *inexact)
+{
+  const char *p = str;
+  const char *start;
+  int ndigits = 0, dropped = 0, point = 0, exp = 0, eneg;
+  int seen = FALSE;
+
+  while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) p++;
+  *neg = FALSE;
+  if (p < end && (*p == '-' || *p == '+')) *neg = (*p++ == '-');
+  if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    return FALSE;
+  }
+  *m = 0;
+  *inexact = FALSE;
+  for (; p < end; p++) {
+    if (*p >= '0' && *p <= '9') {
+      seen = TRUE;
+      if (ndigits < 19) {
+	if (ndigits > 0 || *p != '0') {
+	  *m = *m * 10 + (*p - '0');
+	  ndigits++;
+	}
+      } else {
+	if (dropped == 0 && *p >= '5') (*m)++;
+	if (*p != '0') *inexact = TRUE;
+	dropped++;
+      }
+      if (point) point++;
+    } else if (*p == '.' && !point) {
+      point = 1;
+    } else {
+      break;
+    }
+  }
+  if (!seen) return FALSE;
+  *rest = p;
+  /*--- point counts digits after '.', plus one; adjust for those used */
+  *e10 = dropped - (point ? point - 1 : 0);
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    start = p++;
+    eneg = FALSE;
+    if (p < end && (*p == '-' || *p == '+')) eneg = (*p++ == '-');
+    if (p < end && *p >= '0' && *p <= '9') {
+      while (p < end && *p >= '0' && *p <= '9') {
+	if (exp < 100000) exp = exp * 10 + (*p - '0');
+	p++;
+      }
+      *e10 += eneg ? -exp : exp;
+      *rest = p;
+    } else {
+      *rest = start;
+    }
+  }
+  return TRUE;
+}
+
+/*--- strtod, or strtof if single, of str up to end, which need not be
+ * terminated; sets rest to what follows, str if nothing was read */
+static double text2strtod(const char *str, const char *end, const char **rest,
+			  int single)
+{
+  char buffer[128];
+  char *copy = buffer, *stop;
+  size_t len = end - str;
+  double d;
+
+  if (len >= sizeof(buffer)) copy = new(len + 1);
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  d = single ? strtof(copy, &stop) : strtod(copy, &stop);
+  *rest = str + (stop - copy);
+  if (copy != buffer) release(copy);
+  return d;
+}
+
+static double text2double(const char *str, const char *end, const char **rest)
+{
+  uint64_t m, bits;
+  int neg, e10, inexact;
+  double d;
+
+  if (! text2decimal(str, end, rest, &neg, &m, &e10, &inexact)) {
+    return text2strtod(str, end, rest, FALSE);
+  }
+  if (m == 0) {
+    d = 0.0;
+  } else if (FLT_EVAL_METHOD == 0 && !inexact && m <= (1ULL << 53) &&
+	     e10 >= -22 && e10 <= 22) {
+    d = (double)m;
+    d = e10 < 0 ? d / exact_pow10[-e10] : d * exact_pow10[e10];
+  } else if (decimal2ieee(m, e10, inexact, 52, 11, &bits)) {
+    memcpy(&d, &bits, sizeof(d));
+  } else {
+    return text2strtod(str, end, rest, FALSE);
+  }
+  return neg ? -d : d;
+}
+
+static float text2float(const char *str, const char *end, const char **rest)
+{
+  uint64_t m, bits;
+  uint32_t bits32;
+  int neg, e10, inexact;
+  float f;
+
+  if (! text2decimal(str, end, rest, &neg, &m, &e10, &inexact)) {
+    return text2strtod(str, end, rest, TRUE);
+  }
+  if (m == 0) {
+    f = 0.0f;
+  } else if (FLT_EVAL_METHOD == 0 && !inexact && m <= (1ULL << 24) &&
+	     e10 >= -10 && e10 <= 10) {
+    f = (float)m;
+    f = e10 < 0 ? f / exact_pow10f[-e10] : f * exact_pow10f[e10];
+  } else if (decimal2ieee(m, e10, inexact, 23, 8, &bits)) {
+    bits32 = bits;
+    memcpy(&f, &bits32, sizeof(f));
+  } else {
+    return text2strtod(str, end, rest, TRUE);
+  }
+  return neg ? -f : f;
+}
+
+/*--- Index of the value equal to the len characters at str, or -1 */
+static int amatch(const char *str, int len, char const * const *vals, int nval)
+{
+  int i;
+  for (i=0; i<nval; i++) {
+    if (strncmp(str, vals[i], len) == 0 && vals[i][len] == '\0') return i;
+  }
+  return -1;
+}
+
+/*-----------------------------------------------------------------------
+ *	Date arithmetic
+ *	Civil dates from day numbers and back are pure integer arithmetic
+ *	(H. Hinnant's algorithms), valid far beyond 1970-2038.  The local
+ *	time zone offset is found with localtime_r only when a time falls
+ *	outside the interval over which the last offset is known to hold;
+ *	that interval is widened by probing up to ZONE_SPAN either side
+ *	and bisecting to the exact transition.  Each thread has its own.
+ *-----------------------------------------------------------------------*/
+#ifdef __sunos5__
+# define THREAD_LOCAL			/* Ancient gcc */
+#else
+# define THREAD_LOCAL __thread
+#endif
+
+#define ZONE_SPAN (30*86400L)		/* No two transitions closer */
+
+typedef struct {
+  time_t lo, hi;			/* Offset holds for lo <= t < hi */
+  long offset;				/* Local time minus UTC */
+} ZoneCache;
+
+static THREAD_LOCAL ZoneCache zone_cache;
+
+/*--- Days since 1970-01-01 of y-m-d, month 1..12, any day */
+static int64_t days_from_civil(int64_t y, int m, int d)
+{
+  int64_t era, yoe, doy, doe;
+  y -= m <= 2;
+  era = (y >= 0 ? y : y - 399) / 400;
+  yoe = y - era * 400;
+  doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t *py, int *pm, int *pd)
+{
+  int64_t era, doe, yoe, doy, mp;
+  z += 719468;
+  era = (z >= 0 ? z : z - 146096) / 146097;
+  doe = z - era * 146097;
+  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  mp = (5 * doy + 2) / 153;
+  *pd = doy - (153 * mp + 2) / 5 + 1;
+  *pm = mp < 10 ? mp + 3 : mp - 9;
+  *py = yoe + era * 400 + (*pm <= 2);
+}
+
+/*--- Seconds since epoch of broken-down time taken as UTC */
+static int64_t tm2seconds(const struct tm *tm)
+{
+  return days_from_civil(tm->tm_year + 1900LL, tm->tm_mon + 1, tm->tm_mday)
+    * 86400 + tm->tm_hour * 3600L + tm->tm_min * 60L + tm->tm_sec;
+}
+
+static long zone_probe(time_t t)
+{
+  struct tm tm;
+  if (localtime_r(&t, &tm) == NULL) return 0;
+  return tm2seconds(&tm) - t;
+}
+
+/*--- First time after same (with offset) up to diff (without) */
+static time_t zone_bisect(time_t same, time_t diff, long offset)
+{
+  time_t mid;
+  while (same - diff > 1 || diff - same > 1) {
+    mid = same + (diff - same) / 2;
+    if (zone_probe(mid) == offset) {
+      same = mid;
+    } else {
+      diff = mid;
+    }
+  }
+  return diff;
+}
+
+static pthread_once_t zone_once = PTHREAD_ONCE_INIT;
+
+static long zone_offset(time_t t)
+{
+  ZoneCache *c = &zone_cache;
+  long offset;
+  time_t probe;
+
+  if (t >= c->lo && t < c->hi) return c->offset;
+  pthread_once(&zone_once, tzset);
+  offset = zone_probe(t);
+  probe = t + ZONE_SPAN;
+  c->hi = (zone_probe(probe) == offset) ? probe + 1
+    : zone_bisect(t, probe, offset);
+  probe = t - ZONE_SPAN;
+  c->lo = (zone_probe(probe) == offset) ? probe
+    : zone_bisect(t, probe, offset) + 1;
+  c->offset = offset;
+  return offset;
+}
+
+/*--- Seconds since epoch of broken-down local (or UTC) time */
+static time_t tm2time(struct tm *tm, int utc)
+{
+  int64_t local = tm2seconds(tm);
+  long offset;
+  time_t t;
+  if (utc) return local;
+  offset = zone_offset(local - zone_cache.offset);
+  t = local - offset;
+  if (zone_offset(t) == offset) return t;
+  /*--- In a transition gap or overlap */
+  tm->tm_isdst = -1;
+  return mktime(tm);
+}
+
+/*-----------------------------------------------------------------------
+ *	Interpret randomly formatted date/time and convert to seconds
+ *	since epoch (Jan 1 1970), plus nanoseconds.
+ *	Tokens are separated by spaces, tabs, newlines or commas, and each
+ *	is classified in one pass without copying:
+ *	  Mon Monday Jan January	(weekday ignored)
+ *	  GMT UTC Z BST +hh +hhmm +hh:mm	zone or offset from UTC
+ *	  hh:mm[:ss[.frac]]
+ *	  yyyy-mm-dd[Thh:mm[:ss[.frac]]][zone]
+ *	  yyyymmdd[Thhmmss[.frac]][zone]
+ *	  yyyy/mm/dd yy/mm/dd mm/dd  dd  yyyy
+ *	Years run 1-9999, two-digit years 1970-2069.
+ *	Times without zone are local, or UTC if utc is set.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  struct tm tm;
+  long nsec;
+  long offset;				/* Seconds east of UTC */
+  int have_year, have_month, have_day;
+  int have_hour, have_min, have_sec;
+  int have_offset;
+} DateParse;
+
+static int date_sep(int c)
+{
+  return c == ' ' || c == ',' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*--- Up to max digits; returns how many */
+static int lex_num(const char **pp, const char *end, int max, int *val)
+{
+  const char *p = *pp;
+  int n = 0, v = 0;
+  while (p < end && n < max && *p >= '0' && *p <= '9') {
+    v = v * 10 + (*p++ - '0');
+    n++;
+  }
+  *pp = p;
+  *val = v;
+  return n;
+}
+
+static int lex_char(const char **pp, const char *end, int c)
+{
+  if (*pp < end && **pp == c) {
+    (*pp)++;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/*--- Optional ".digits" as nanoseconds */
+static void lex_frac(const char **pp, const char *end, DateParse *d)
+{
+  const char *p = *pp;
+  long scale = 100000000;
+  if (!lex_char(&p, end, '.')) return;
+  d->nsec = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    d->nsec += (*p - '0') * scale;
+    scale /= 10;
+  }
+  *pp = p;
+}
+
+/*--- Optional Z, +hh, +hhmm or +hh:mm; FALSE if malformed */
+static int lex_zone(const char **pp, const char *end, DateParse *d)
+{
+  const char *p = *pp;
+  int sign, hh, mm = 0;
+  if (lex_char(&p, end, 'Z')) {
+    d->offset = 0;
+  } else if (p < end && (*p == '+' || *p == '-')) {
+    sign = (*p++ == '-') ? -1 : 1;
+    if (lex_num(&p, end, 2, &hh) != 2) return FALSE;
+    if (lex_char(&p, end, ':') ? lex_num(&p, end, 2, &mm) != 2
+	: (p < end && lex_num(&p, end, 2, &mm) != 2)) return FALSE;
+    if (hh > 23 || mm > 59) return FALSE;
+    d->offset = sign * (hh * 3600L + mm * 60L);
+  } else {
+    return TRUE;
+  }
+  d->have_offset = TRUE;
+  *pp = p;
+  return TRUE;
+}
+
+static int set_time(DateParse *d, int hh, int mm, int ss, int have_ss)
+{
+  if (hh < 0 || hh > 23 || mm < 0 || mm > 59 ||
+      ss < 0 || ss > 59) return FALSE;	/* Disallow leap seconds */
+  d->tm.tm_hour = hh; d->have_hour = TRUE;
+  d->tm.tm_min = mm; d->have_min = TRUE;
+  if (have_ss) {
+    d->tm.tm_sec = ss; d->have_sec = TRUE;
+  }
+  return TRUE;
+}
+
+static int set_date(DateParse *d, int y, int m, int dd)
+{
+  if (y < 1 || y > 9999 || m < 1 || m > 12 || dd < 1 || dd > 31) {
+    return FALSE;
+  }
+  d->tm.tm_year = y - 1900; d->have_year = TRUE;
+  d->tm.tm_mon = m - 1; d->have_month = TRUE;
+  d->tm.tm_mday = dd; d->have_day = TRUE;
+  return TRUE;
+}
+
+/*--- hh:mm[:ss[.frac]] or (compact) hhmmss[.frac] */
+static int lex_time(const char **pp, const char *end, DateParse *d,
+		    int compact)
+{
+  int hh, mm, ss = 0, have_ss;
+  if (lex_num(pp, end, 2, &hh) < 1) return FALSE;
+  if (compact) {
+    if (lex_num(pp, end, 2, &mm) != 2 || lex_num(pp, end, 2, &ss) != 2) {
+      return FALSE;
+    }
+    have_ss = TRUE;
+  } else {
+    if (!lex_char(pp, end, ':') || lex_num(pp, end, 2, &mm) != 2) {
+      return FALSE;
+    }
+    have_ss = lex_char(pp, end, ':');
+    if (have_ss && lex_num(pp, end, 2, &ss) != 2) return FALSE;
+  }
+  if (have_ss) lex_frac(pp, end, d);
+  return set_time(d, hh, mm, ss, have_ss);
+}
+
+static int date_token(DateParse *d, const char *tok, const char *end)
+{
+  static char const * const wday[14] = {
+    "Sun","Mon","Tue","Wed","Thu","Fri","Sat",
+    "Sunday","Monday","Tuesday","Wednesday","Thursday","Friday","Saturday"
+  };
+  static char const * const mon[24] = {
+    "Jan","Feb","Mar","Apr","May","Jun","Jul","Aug","Sep","Oct","Nov","Dec",
+    "January","February","March","April","May","June",
+    "July","August","September","October","November","December"
+  };
+  static char const * const zone[4] = { "GMT", "UTC", "Z", "BST" };
+  const char *p = tok;
+  int len = end - tok;
+  int i1, i2, i3, n;
+
+  if (isalpha((unsigned char)*p)) {
+    if (amatch(tok, len, wday, 14) >= 0) {
+      /* Redundant - ignore */
+    } else if ((i1 = amatch(tok, len, mon, 24)) >= 0) {
+      d->tm.tm_mon = i1 % 12; d->have_month = TRUE;
+    } else if ((i1 = amatch(tok, len, zone, 4)) >= 0) {
+      d->offset = (i1 == 3) ? 3600 : 0; d->have_offset = TRUE;
+    } else {
+      return FALSE;
+    }
+    return TRUE;
+  }
+  if (*p == '+' || *p == '-') {
+    return lex_zone(&p, end, d) && p == end;
+  }
+  n = lex_num(&p, end, 9, &i1);
+  if (n == 0) return FALSE;
+  if (p == end) {
+    if (i1 >= 1 && i1 <= 31) {
+      d->tm.tm_mday = i1; d->have_day = TRUE;
+    } else if (n == 4 && i1 >= 1000) {
+      d->tm.tm_year = i1 - 1900; d->have_year = TRUE;
+    } else if (n == 8) {
+      return set_date(d, i1 / 10000, i1 / 100 % 100, i1 % 100);
+    } else {
+      return FALSE;
+    }
+    return TRUE;
+  }
+  switch (*p) {
+  case ':':
+    p = tok;
+    return lex_time(&p, end, d, FALSE) && lex_zone(&p, end, d) && p == end;
+  case '-':
+    p++;
+    if (lex_num(&p, end, 2, &i2) < 1 || !lex_char(&p, end, '-') ||
+	lex_num(&p, end, 2, &i3) < 1 || !set_date(d, i1, i2, i3)) {
+      return FALSE;
+    }
+    if (lex_char(&p, end, 'T') && !lex_time(&p, end, d, FALSE)) return FALSE;
+    return lex_zone(&p, end, d) && p == end;
+  case 'T':
+    if (n != 8 || !set_date(d, i1 / 10000, i1 / 100 % 100, i1 % 100)) {
+      return FALSE;
+    }
+    p++;
+    return lex_time(&p, end, d, TRUE) && lex_zone(&p, end, d) && p == end;
+  case '/':
+    p++;
+    if (lex_num(&p, end, 2, &i2) < 1) return FALSE;
+    if (p == end) {			/* m/d */
+      if (i1 < 1 || i1 > 12 || i2 < 1 || i2 > 31) return FALSE;
+      d->tm.tm_mon = i1 - 1; d->have_month = TRUE;
+      d->tm.tm_mday = i2; d->have_day = TRUE;
+      return TRUE;
+    }
+    if (!lex_char(&p, end, '/') || lex_num(&p, end, 2, &i3) < 1 || p != end) {
+      return FALSE;
+    }
+    if (i1 >= 70 && i1 <= 99) i1 += 1900;
+    else if (i1 >= 0 && i1 < 70) i1 += 2000;
+    return set_date(d, i1, i2, i3);
+  }
+  return FALSE;
+}
+
+int text2date(const char *str, const char *end, time_t *p_time,
+		     long *p_nsec, int utc)
+{
+  static THREAD_LOCAL struct tm today;	/* Broken down today_time */
+  static THREAD_LOCAL time_t today_time = -1;
+  time_t now = time(NULL);
+  DateParse d;
+  const char *p, *tok;
+
+  if (now != today_time) {
+    /*--- Only once a second, but never stale in a long-lived process */
+    localtime_r(&now, &today);
+    today_time = now;
+  }
+  memset(&d, 0, sizeof(d));
+  d.tm = today;
+  for (p = str; ; ) {
+    while (p < end && date_sep(*p)) p++;
+    if (p >= end) break;
+    for (tok = p; p < end && !date_sep(*p); p++)
+      ;
+    if (!date_token(&d, tok, p)) return FALSE;
+  }
+  /*--- If date given, assume midnight unless time given too */
+  if (d.have_year || d.have_month || d.have_day) {
+    if (!d.have_hour) d.tm.tm_hour = 0;
+    if (!d.have_min) d.tm.tm_min = 0;
+    if (!d.have_sec) d.tm.tm_sec = 0;
+  } else {
+    /*--- Just a time today, but "" -> now */
+    if (d.have_min && !d.have_sec) d.tm.tm_sec = 0;
+  }
+  if (d.have_offset) {
+    *p_time = tm2seconds(&d.tm) - d.offset;
+  } else {
+    *p_time = tm2time(&d.tm, utc);
+  }
+  if (p_nsec) *p_nsec = d.nsec;
+  return TRUE;
+}
+
+/*--- Units per second and nanoseconds per unit of each epoch */
+static const int64_t epoch_scale[] = { 1, 1000, 1000000, 1000000000, 1 };
+static const long epoch_nsec[] = { 1000000000, 1000000, 1000, 1, 1 };
+
+/*--- Store seconds plus nanoseconds as the given epoch; FALSE if too big */
+static int date2epoch(int64_t t, long nsec, enum Epoch epoch, Uscalar *u)
+{
+  int64_t limit = INT64_MAX / epoch_scale[epoch] - 1;
+
+  switch (epoch) {
+  case EPOCH_SECONDS:
+    u->time = t;
+    return u->time == t;
+  case EPOCH_DOUBLE:
+    u->dval = t + nsec * 1e-9;
+    return TRUE;
+  default:
+    if (t > limit || t < -limit) return FALSE;
+    u->i64 = t * epoch_scale[epoch] + nsec / epoch_nsec[epoch];
+    return TRUE;
+  }
+}
+
+/*-----------------------------------------------------------------------
+ *	Input converter
+ *	Reads raw (binary) data from a producer via a conversion.
+ *	The common types have kernels specialised by type, chosen once
+ *	when the converter is created; the rest go through inconv_value.
+ *-----------------------------------------------------------------------*/
+typedef struct Inconv Inconv;
+typedef int (*ParseKernel)(Inconv *, char *, int, char **);
+
+struct Inconv {
+  Producer child;
+  void *closure;
+  Conversion *conv;
+  ParseKernel kernel;
+  Uscalar u;
+  int unit;
+  char *block;
+  long count;				/* Values read so far */
+  long badvalue;			/* First unparsable, or 0 */
+};
+
+static const int inconv_base[] = {
+  /*STYLE_DEFAULT*/ 0, /*BINARY*/ 2, /*OCTAL*/ 8, /*DECIMAL*/ 10, /*HEX*/ 16
+};
+
+static ParseKernel inconv_kernel(const Conversion *conv);
+
+static void *inconv_create(Conversion *conv, Producer child, void *closure)
+{
+  Inconv *this = NEW(Inconv);
+  this->child = child;
+  this->closure = closure;
+  this->conv = conv;
+  this->kernel = inconv_kernel(conv);
+  this->unit = conversion_size(conv);
+  this->block = this->unit ? new(this->unit * BLOCK_VALUES) : NULL;
+  this->count = 0;
+  this->badvalue = 0;
+  return this;
+}
+
+/*--- Warn (once) of text that is not wholly a number */
+static void inconv_check(Inconv *this, const char *str, const char *rest,
+			 const char *end)
+{
+  if (this->badvalue == 0) {
+    while (rest < end && isspace((unsigned char)*rest)) rest++;
+    if (rest == str || rest < end) {
+      int len = end - str;
+      while (len > 0 && isspace((unsigned char)str[len-1])) len--;
+      this->badvalue = this->count;
+      fprintf(stderr, "%s: Unparsable value %ld \"%.*s\" at offset %d\n",
+	      cconv_progname, this->count, len, str, (int)(rest - str));
+    }
+  }
+}
+
+static int inconv_value(Inconv *this, char *str, int len, char **data)
+{
+  Conversion *conv = this->conv;
+  const char *rest;
+  int num = 0;
+  long lval = 0;
+
+  this->count++;
+  switch (conv->type) {
+  case TYPE_CHAR: case TYPE_SHORT: case TYPE_INT: case TYPE_LONG:
+    lval = text2long(str, str + len, &rest, inconv_base[conv->style]);
+    inconv_check(this, str, rest, str + len);
+    switch (conv->type) {
+    case TYPE_CHAR:
+      this->u.cval = lval;
+      *data = this->u.bytes;
+      num = sizeof(char);
+      break;
+    case TYPE_SHORT:
+      this->u.sval = lval;
+      *data = this->u.bytes;
+      num = sizeof(short);
+      break;
+    case TYPE_INT:
+      this->u.ival = lval;
+      *data = this->u.bytes;
+      num = sizeof(int);
+      break;
+    case TYPE_LONG:
+      this->u.lval = lval;
+      *data = this->u.bytes;
+      num = sizeof(long);
+      break;
+    default:;
+    }
+    break;
+  case TYPE_FLOAT:
+    this->u.fval = text2float(str, str + len, &rest);
+    inconv_check(this, str, rest, str + len);
+    *data = this->u.bytes;
+    num = sizeof(float);
+    break;
+  case TYPE_DOUBLE:
+    this->u.dval = text2double(str, str + len, &rest);
+    inconv_check(this, str, rest, str + len);
+    *data = this->u.bytes;
+    num = sizeof(double);
+    break;
+  case TYPE_STRING:
+    switch (conv->quoting) {
+    case QUOTING_NONE:
+      num = len;
+      *data = str;
+      break;
+    case QUOTING_SHELL:
+#if NOTYET
+      num = shell_unquote(str, buffer);
+#else
+      fail("Shell quoting not implemented yet");
+#endif
+      break;
+    case QUOTING_TCL:
+#if NOTYET
+      num = tcl_unquote(str, buffer);
+#else
+      fail("Tcl quoting not implemented yet");
+#endif
+      break;
+    } break;
+#if HAVE_POINT
+  case TYPE_POINT: {
+    c9error_jt err;
+    err = cdnmpak(this->u.pknam, str);
+    if (err != 0) {
+      c9report(EVSTM, err, NULL);
+      exit(1);
+    }
+    *data = this->u.bytes;
+    num = sizeof(this->u.pknam);
+  } break;
+#endif
+#if HAVE_BCN
+  case TYPE_BCN: {
+    int b, c, n;
+    if (sscanf(str, "%d %d %d", &b, &c, &n) == 3 ||
+	sscanf(str, "%d,%d,%d", &b, &c, &n) == 3) {
+      cmdbcn(&this->u.sval, b, c, n);
+      *data = this->u.bytes;
+      num = sizeof(short);
+    } else {
+      fail("Unrecognised BCN");
+    }
+  } break;
+#endif
+#if HAVE_NORDFLOAT
+  case TYPE_NORDFLOAT: {
+    union {
+      float fval;
+      short shalf[2];
+    } ieee;
+    ieee.fval = text2float(str, str + len, &rest);
+    inconv_check(this, str, rest, str + len);
+#ifdef __linux__
+    {
+      /* Assume the "native" byte ordering for Nordfloat is three shorts
+       * in the same order as SunOS but each in native byte-order.
+       */
+      /*--- First convert into two shorts, big end first,
+       * ready for conversion.
+       * E.g. 3.14159265 -> 0x40490fdb -> [0x4049, 0x0fdb]
+       */
+      short hilo[2];
+      hilo[0] = ieee.shalf[1];
+      hilo[1] = ieee.shalf[0];
+
+      /*--- Do the conversion e.g. -> [0x4002, 0xc90f, 0xdb00] */
+      cf32to48_(hilo, this->u.nf);
+    }
+#else
+    cf32to48_(ieee.shalf, this->u.nf);
+#endif
+    *data = this->u.bytes;
+    num = sizeof(this->u.nf);
+  } break;
+#endif
+  case TYPE_DATE: {
+    time_t t;
+    long nsec;
+    if (!text2date(str, str + len, &t, &nsec, /*utc=*/conv->unsignedp)) {
+      fail("Unrecognised date");
+    }
+    if (!date2epoch(t, nsec, conv->epoch, &this->u)) {
+      fail("Date out of range");
+    }
+    *data = this->u.bytes;
+    num = conversion_size(conv);
+  } break;
+  }
+
+  return num;
+}
+
+/*--- Specialised kernels, as inconv_value for one type */
+#define INCONV_INT(name, member)					\
+static int name(Inconv *this, char *str, int len, char **data)		\
+{									\
+  const char *rest;							\
+  this->count++;							\
+  this->u.member = text2long(str, str + len, &rest,			\
+			     inconv_base[this->conv->style]);		\
+  inconv_check(this, str, rest, str + len);				\
+  *data = this->u.bytes;						\
+  return sizeof(this->u.member);					\
+}
+INCONV_INT(inconv_char, cval)
+INCONV_INT(inconv_short, sval)
+INCONV_INT(inconv_int, ival)
+INCONV_INT(inconv_long, lval)
+#undef INCONV_INT
+
+static int inconv_float(Inconv *this, char *str, int len, char **data)
+{
+  const char *rest;
+  this->count++;
+  this->u.fval = text2float(str, str + len, &rest);
+  inconv_check(this, str, rest, str + len);
+  *data = this->u.bytes;
+  return sizeof(float);
+}
+
+static int inconv_double(Inconv *this, char *str, int len, char **data)
+{
+  const char *rest;
+  this->count++;
+  this->u.dval = text2double(str, str + len, &rest);
+  inconv_check(this, str, rest, str + len);
+  *data = this->u.bytes;
+  return sizeof(double);
+}
+
+static ParseKernel inconv_kernel(const Conversion *conv)
+{
+  switch (conv->type) {
+  case TYPE_CHAR:	return inconv_char;
+  case TYPE_SHORT:	return inconv_short;
+  case TYPE_INT:	return inconv_int;
+  case TYPE_LONG:	return inconv_long;
+  case TYPE_FLOAT:	return inconv_float;
+  case TYPE_DOUBLE:	return inconv_double;
+  default:		return inconv_value;
+  }
+}
+
+/*--- One value at a time */
+static int inconv_get(void *closure, char **data, int size)
+{
+  Inconv *this = closure;
+  char *str;
+  int len;
+
+  if ((len = this->child(this->closure, &str, 1024)) < 0) return -1;
+  return this->kernel(this, str, len, data);
+}
+
+/*--- As many whole values as fit in size, up to BLOCK_VALUES */
+static int inconv_get_block(void *closure, char **data, int size)
+{
+  Inconv *this = closure;
+  ParseKernel kernel = this->kernel;
+  int unit = this->unit;
+  int n, max, len;
+  char *str, *value;
+
+  max = size / unit;
+  if (max < 1) max = 1;
+  if (max > BLOCK_VALUES) max = BLOCK_VALUES;
+  for (n = 0; n < max; n++) {
+    if ((len = this->child(this->closure, &str, 1024)) < 0) break;
+    kernel(this, str, len, &value);
+    memcpy(this->block + n*unit, value, unit);
+  }
+  if (n == 0) return -1;
+  *data = this->block;
+  return n*unit;
+}
+
+/*-----------------------------------------------------------------------
+ *	Integer to text
+ *	Digits are generated from the least significant end into a scratch
+ *	area, two at a time for decimal, then zero-padded to at least width
+ *	digits and copied out.  Binary expands eight bits at once.
+ *	Each returns the length of the text, which is not NUL-terminated.
+ *-----------------------------------------------------------------------*/
+static const char digit_pairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+static const char hex_digits[] = "0123456789abcdef";
+
+/*--- Pad digits ending at end to width, and copy to buf */
+static int format_out(char *buf, char *p, char *end, int width)
+{
+  int len;
+  if (width > FORMAT_MAXWIDTH) width = FORMAT_MAXWIDTH;
+  while (end - p < width) *--p = '0';
+  len = end - p;
+  memcpy(buf, p, len);
+  return len;
+}
+
+static int format_dec(char *buf, unsigned long val, int width)
+{
+  char tmp[FORMAT_MAXWIDTH], *end = tmp + sizeof(tmp), *p = end;
+  while (val >= 100) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2*(val % 100), 2);
+    val /= 100;
+  }
+  if (val >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + 2*val, 2);
+  } else {
+    *--p = '0' + val;
+  }
+  return format_out(buf, p, end, width);
+}
+
+static int format_hex(char *buf, unsigned long val, int width)
+{
+  char tmp[FORMAT_MAXWIDTH], *end = tmp + sizeof(tmp), *p = end;
+  do {
+    *--p = hex_digits[val & 15];
+    val >>= 4;
+  } while (val != 0);
+  return format_out(buf, p, end, width);
+}
+
+static int format_oct(char *buf, unsigned long val, int width)
+{
+  char tmp[FORMAT_MAXWIDTH], *end = tmp + sizeof(tmp), *p = end;
+  do {
+    *--p = '0' + (val & 7);
+    val >>= 3;
+  } while (val != 0);
+  return format_out(buf, p, end, width);
+}
+
+/*--- Always bits digits, most significant first */
+static int format_bin(char *buf, unsigned long val, int bits, int width)
+{
+  static const union { uint16_t v; char b[2]; } endian = { 1 };
+  /*--- Select bit 7-i of a byte into byte i of the result in memory */
+  const uint64_t select = endian.b[0] ? 0x0102040810204080ULL
+				      : 0x8040201008040201ULL;
+  char tmp[FORMAT_MAXWIDTH], *end = tmp + sizeof(tmp), *p = end;
+  uint64_t x;
+  int i;
+  for (i = 0; i < bits; i += 8) {
+    x = ((val >> i) & 0xff) * 0x0101010101010101ULL & select;
+    x = ((x + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+    x += 0x3030303030303030ULL;		/* '0' or '1' in each byte */
+    p -= 8;
+    memcpy(p, &x, 8);
+  }
+  return format_out(buf, p, end, width);
+}
+
+/*-----------------------------------------------------------------------
+ *	Floating point to text
+ *	Shortest digits that read back to the same value, using the Grisu2
+ *	algorithm (Loitsch, "Printing floating-point numbers quickly and
+ *	accurately with integers", PLDI 2010).  The digits always lie
+ *	within the rounding interval of the value, and are nearly always
+ *	the shortest such.  Works for any binary format of up to 64 bits
+ *	of significand, so float values get their own shorter interval.
+ *-----------------------------------------------------------------------*/
+/*--- Cached power c with exponent such that c*2^e has -60..-32 */
+static DiyFp cached_power(int e, int *K)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  int index;
+  DiyFp c;
+  if (dk - k > 0.0) k++;
+  index = (k >> 3) + 1;
+  *K = -(-348 + index * 8);
+  c.f = cached_power_f[index];
+  c.e = cached_power_e[index];
+  return c;
+}
+
+static void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest,
+			uint64_t ten_kappa, uint64_t wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+	 (rest + ten_kappa < wp_w ||
+	  wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[len-1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int digit_gen(DiyFp W, DiyFp Mp, uint64_t delta, char *buffer, int *K)
+{
+  int shift = -Mp.e;
+  uint64_t one = 1ULL << shift;
+  uint64_t wp_w = Mp.f - W.f;
+  uint32_t p1 = Mp.f >> shift;
+  uint64_t p2 = Mp.f & (one - 1);
+  uint64_t tmp;
+  int kappa, len = 0, d;
+
+  for (kappa = 1; kappa < 10 && p1 >= pow10_table[kappa]; kappa++)
+    ;
+  while (kappa > 0) {
+    d = p1 / pow10_table[kappa-1];
+    p1 %= pow10_table[kappa-1];
+    if (d || len) buffer[len++] = '0' + d;
+    kappa--;
+    tmp = ((uint64_t)p1 << shift) + p2;
+    if (tmp <= delta) {
+      *K += kappa;
+      grisu_round(buffer, len, delta, tmp, pow10_table[kappa] << shift, wp_w);
+      return len;
+    }
+  }
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    d = p2 >> shift;
+    if (d || len) buffer[len++] = '0' + d;
+    p2 &= one - 1;
+    kappa--;
+    if (p2 < delta) {
+      *K += kappa;
+      grisu_round(buffer, len, delta, p2, one,
+		  -kappa < 20 ? wp_w * pow10_table[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+/*--- Digits of f*2^e (f != 0), value is digits*10^K; returns length */
+static int grisu2(uint64_t f, int e, uint64_t hidden, char *buffer, int *K)
+{
+  DiyFp v, pl, mi, c, W, Wp, Wm;
+  v.f = f;
+  v.e = e;
+  pl.f = (f << 1) + 1;
+  pl.e = e - 1;
+  pl = diyfp_normalize(pl);
+  if (f == hidden) {
+    mi.f = (f << 2) - 1;
+    mi.e = e - 2;
+  } else {
+    mi.f = (f << 1) - 1;
+    mi.e = e - 1;
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  c = cached_power(pl.e, K);
+  W = diyfp_mul(diyfp_normalize(v), c);
+  Wp = diyfp_mul(pl, c);
+  Wm = diyfp_mul(mi, c);
+  Wm.f++;
+  Wp.f--;
+  return digit_gen(W, Wp, Wp.f - Wm.f, buffer, K);
+}
+
+/*--- Lay out digits*10^K as %g would, without trailing zeros */
+static int format_digits(char *buf, const char *digits, int len, int K)
+{
+  char *p = buf;
+  int exp = len + K - 1;		/* Of first digit */
+  int i;
+  if (exp < -4 || exp >= 16) {
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits+1, len-1);
+      p += len-1;
+    }
+    *p++ = 'e';
+    *p++ = exp < 0 ? '-' : '+';
+    if (exp < 0) exp = -exp;
+    if (exp >= 100) {
+      *p++ = '0' + exp / 100;
+      exp %= 100;
+    }
+    memcpy(p, digit_pairs + 2*exp, 2);
+    p += 2;
+  } else if (K >= 0) {
+    memcpy(p, digits, len);
+    p += len;
+    for (i = 0; i < K; i++) *p++ = '0';
+  } else if (exp >= 0) {
+    memcpy(p, digits, exp+1);
+    p += exp+1;
+    *p++ = '.';
+    memcpy(p, digits+exp+1, len-exp-1);
+    p += len-exp-1;
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for (i = -1; i > exp; i--) *p++ = '0';
+    memcpy(p, digits, len);
+    p += len;
+  }
+  return p - buf;
+}
+
+/*--- Shortest text for IEEE value with mbits of stored significand */
+static int format_ieee(char *buf, uint64_t bits, int mbits, int ebits)
+{
+  uint64_t hidden = 1ULL << mbits;
+  uint64_t f = bits & (hidden - 1);
+  int bias = (1 << (ebits-1)) - 1;
+  int be = (bits >> mbits) & ((1 << ebits) - 1);
+  int neg = (bits >> (mbits + ebits)) & 1;
+  char digits[20], *p = buf;
+  int len, K;
+
+  if (neg) *p++ = '-';
+  if (be == (1 << ebits) - 1) {
+    if (f != 0) {
+      memcpy(p, "nan", 3);
+    } else {
+      memcpy(p, "inf", 3);
+    }
+    return p + 3 - buf;
+  }
+  if (be == 0 && f == 0) {
+    *p = '0';
+    return p + 1 - buf;
+  }
+  if (be != 0) {
+    f |= hidden;
+  } else {
+    be = 1;				/* Subnormal */
+  }
+  len = grisu2(f, be - bias - mbits, hidden, digits, &K);
+  return p - buf + format_digits(p, digits, len, K);
+}
+
+static int format_double(char *buf, double val, int precision)
+{
+  uint64_t bits;
+  if (precision == PRECISION_SHORTEST) {
+    memcpy(&bits, &val, sizeof(bits));
+    return format_ieee(buf, bits, 52, 11);
+  } else if (precision > 0) {
+    return sprintf(buf, "%.*g", precision, val);
+  } else {
+    return sprintf(buf, "%g", val);
+  }
+}
+
+static int format_float(char *buf, float val, int precision)
+{
+  uint32_t bits;
+  if (precision == PRECISION_SHORTEST) {
+    memcpy(&bits, &val, sizeof(bits));
+    return format_ieee(buf, bits, 23, 8);
+  } else {
+    return format_double(buf, val, precision);
+  }
+}
+
+/*-----------------------------------------------------------------------
+ *	Date to text, as asctime: "Thu Jan  1 00:00:00 1970"
+ *	or, for sub-second epochs, ISO-8601: "1970-01-01T00:00:00.000Z"
+ *-----------------------------------------------------------------------*/
+/*--- Fraction digits shown for each epoch; double holds about us */
+static const int epoch_digits[] = { 0, 3, 6, 9, 6 };
+
+/*--- Seconds and nanoseconds of binary date; FALSE if not representable */
+static int epoch2date(const Uscalar *u, enum Epoch epoch, int64_t *p_t,
+		      long *p_nsec)
+{
+  int64_t t, frac;
+  double d;
+
+  switch (epoch) {
+  case EPOCH_SECONDS:
+    *p_t = u->time;
+    *p_nsec = 0;
+    return TRUE;
+  case EPOCH_DOUBLE:
+    d = u->dval;
+    if (!(d > -1e15 && d < 1e15)) return FALSE;	/* Also NaN */
+    t = (int64_t)d;
+    if (t > d) t--;
+    frac = (int64_t)((d - t) * 1e6 + 0.5);
+    if (frac >= 1000000) {
+      t++;
+      frac -= 1000000;
+    }
+    *p_t = t;
+    *p_nsec = frac * 1000;
+    return TRUE;
+  default:
+    t = u->i64 / epoch_scale[epoch];
+    frac = u->i64 % epoch_scale[epoch];
+    if (frac < 0) {
+      t--;
+      frac += epoch_scale[epoch];
+    }
+    *p_t = t;
+    *p_nsec = frac * epoch_nsec[epoch];
+    return TRUE;
+  }
+}
+
+/*--- yyyy-mm-ddThh:mm:ss[.digits] then Z (utc) or +hh:mm */
+static int format_iso(char *buf, int64_t t, long nsec, int digits,
+		      long offset, int utc)
+{
+  int64_t days, year;
+  long secs;
+  int month, day;
+  char *p = buf;
+
+  t += offset;
+  days = (t >= 0 ? t : t - 86399) / 86400;
+  secs = t - days * 86400;
+  civil_from_days(days, &year, &month, &day);
+  if (year < 0) {
+    *p++ = '-';
+    year = -year;
+  }
+  p += format_dec(p, year, 4);
+  p[0] = '-';
+  memcpy(p + 1, digit_pairs + 2 * month, 2);
+  p[3] = '-';
+  memcpy(p + 4, digit_pairs + 2 * day, 2);
+  p[6] = 'T';
+  memcpy(p + 7, digit_pairs + 2 * (secs / 3600), 2);
+  p[9] = ':';
+  memcpy(p + 10, digit_pairs + 2 * (secs / 60 % 60), 2);
+  p[12] = ':';
+  memcpy(p + 13, digit_pairs + 2 * (secs % 60), 2);
+  p += 15;
+  if (digits > 0) {
+    *p++ = '.';
+    format_dec(p, nsec, 9);		/* Keep the leading digits */
+    p += digits;
+  }
+  if (utc) {
+    *p++ = 'Z';
+  } else {
+    if (offset < 0) {
+      *p++ = '-';
+      offset = -offset;
+    } else {
+      *p++ = '+';
+    }
+    memcpy(p, digit_pairs + 2 * (offset / 3600), 2);
+    p[2] = ':';
+    memcpy(p + 3, digit_pairs + 2 * (offset / 60 % 60), 2);
+    p += 5;
+  }
+  return p - buf;
+}
+
+static int format_date(char *buf, int64_t t)
+{
+  static const char names[] =
+    "SunMonTueWedThuFriSat" "JanFebMarAprMayJunJulAugSepOctNovDec";
+  int64_t days = (t >= 0 ? t : t - 86399) / 86400;
+  long secs = t - days * 86400;
+  int64_t year;
+  int month, day;
+  char *p = buf;
+
+  civil_from_days(days, &year, &month, &day);
+  memcpy(p, names + 3 * (((days + 4) % 7 + 7) % 7), 3);
+  p[3] = ' ';
+  memcpy(p + 4, names + 21 + 3 * (month - 1), 3);
+  p[7] = ' ';
+  if (day < 10) {
+    p[8] = ' ';
+    p[9] = '0' + day;
+  } else {
+    memcpy(p + 8, digit_pairs + 2 * day, 2);
+  }
+  p[10] = ' ';
+  memcpy(p + 11, digit_pairs + 2 * (secs / 3600), 2);
+  p[13] = ':';
+  memcpy(p + 14, digit_pairs + 2 * (secs / 60 % 60), 2);
+  p[16] = ':';
+  memcpy(p + 17, digit_pairs + 2 * (secs % 60), 2);
+  p[19] = ' ';
+  p += 20;
+  if (year < 0) {
+    *p++ = '-';
+    year = -year;
+  }
+  p += format_dec(p, year, 0);
+  return p - buf;
+}
+
+/*-----------------------------------------------------------------------
+ *	Buffered output writer
+ *	Values are formatted straight into a large buffer, separated by
+ *	the separator string, which is flushed with write(2), or copied to
+ *	memory for the library.  A newline follows the last value.
+ *-----------------------------------------------------------------------*/
+#define OUTPUT_SIZE (1024*1024)
+
+typedef struct {
+  int fd;
+  char *mem;				/* Copy here instead of fd, if set */
+  long memlen, memsize;
+  int overflow;				/* More than memsize to copy */
+  char *buffer;
+  int len;
+  const char *sep;
+  int seplen;
+  int seproom;				/* Most bytes between two values */
+  int perline;				/* Values per line, 0 if no limit */
+  long count;				/* Values written */
+  long long written;			/* Bytes written */
+  Stage *stats;				/* Time writes, if set */
+} Output;
+
+static Output *output_create(int fd, const char *sep, int perline)
+{
+  Output *this = NEW(Output);
+  this->fd = fd;
+  this->mem = NULL;
+  this->memlen = this->memsize = 0;
+  this->overflow = FALSE;
+  this->buffer = new(OUTPUT_SIZE);
+  this->len = 0;
+  this->sep = sep;
+  this->seplen = strlen(sep);
+  this->seproom = (perline && this->seplen < 1) ? 1 : this->seplen;
+  this->perline = perline;
+  this->count = 0;
+  this->written = 0;
+  this->stats = NULL;
+  return this;
+}
+
+/*--- Write all of iov, retrying after partial writes */
+static void output_send(Output *this, struct iovec *iov, int niov)
+{
+  ssize_t num;
+  if (this->mem != NULL) {
+    for (; niov > 0; iov++, niov--) {
+      num = iov->iov_len;
+      if (num > this->memsize - this->memlen) {
+	num = this->memsize - this->memlen;
+	this->overflow = TRUE;
+      }
+      memcpy(this->mem + this->memlen, iov->iov_base, num);
+      this->memlen += num;
+    }
+    return;
+  }
+  while (niov > 0) {
+    num = writev(this->fd, iov, niov);
+    if (num < 0) {
+      if (errno == EINTR) continue;
+      fail("Write error: %s", strerror(errno));
+    }
+    while (niov > 0 && (size_t)num >= iov->iov_len) {
+      num -= iov->iov_len;
+      iov++, niov--;
+    }
+    if (niov > 0) {
+      iov->iov_base = (char *)iov->iov_base + num;
+      iov->iov_len -= num;
+    }
+  }
+}
+
+static void output_writev(Output *this, struct iovec *iov, int niov)
+{
+  long long t;
+  long size = 0;
+  int i;
+
+  for (i = 0; i < niov; i++) {
+    size += iov[i].iov_len;
+  }
+  this->written += size;
+  if (this->stats == NULL) {
+    output_send(this, iov, niov);
+    return;
+  }
+  t = stats_now();
+  output_send(this, iov, niov);
+  this->stats->ns += stats_now() - t;
+  this->stats->calls++;
+  this->stats->bytes += size;
+}
+
+static void output_flush(Output *this)
+{
+  struct iovec iov;
+  if (this->len == 0) return;
+  iov.iov_base = this->buffer;
+  iov.iov_len = this->len;
+  output_writev(this, &iov, 1);
+  this->len = 0;
+}
+
+/*--- Return space for at least size bytes */
+static char *output_reserve(Output *this, int size)
+{
+  if (this->len + size > OUTPUT_SIZE) {
+    output_flush(this);
+  }
+  return this->buffer + this->len;
+}
+
+/*--- Raw data, written directly alongside the buffer if large */
+static void output_write(Output *this, const char *data, int size)
+{
+  struct iovec iov[2];
+  if (this->len + size <= OUTPUT_SIZE) {
+    memcpy(this->buffer + this->len, data, size);
+    this->len += size;
+  } else {
+    iov[0].iov_base = this->buffer;
+    iov[0].iov_len = this->len;
+    iov[1].iov_base = (char *)data;
+    iov[1].iov_len = size;
+    output_writev(this, iov, 2);
+    this->len = 0;
+  }
+}
+
+/*--- What goes before value index: nothing, separator or newline */
+static char *output_sep_at(const Output *this, char *p, long index)
+{
+  if (index == 0) return p;
+  if (this->perline && index % this->perline == 0) {
+    *p++ = '\n';
+  } else {
+    memcpy(p, this->sep, this->seplen);
+    p += this->seplen;
+  }
+  return p;
+}
+
+/*--- Separator before all but the first value */
+static char *output_separate(char *p, Output *this)
+{
+  return output_sep_at(this, p, this->count++);
+}
+
+/*--- One text value of given length */
+static void output_value(Output *this, const char *str, int size)
+{
+  char *p = output_reserve(this, this->seproom + size);
+  p = output_separate(p, this);
+  memcpy(p, str, size);
+  this->len = p + size - this->buffer;
+}
+
+/*--- Terminate text output and flush */
+static void output_finish(Output *this)
+{
+  if (this->count > 0) {
+    output_write(this, "\n", 1);
+  }
+  output_flush(this);
+}
+
+/*-----------------------------------------------------------------------
+ *	Output conversion
+ *	As for input, common types and styles have specialised kernels,
+ *	chosen once; the rest go through outconv_value.
+ *-----------------------------------------------------------------------*/
+#define OUTCONV_MAXTEXT 72		/* Longest text for one value */
+
+typedef int (*FormatKernel)(Conversion *, const char *, char *);
+
+static FormatKernel outconv_kernel(const Conversion *conv);
+
+typedef struct {
+  Producer child;
+  void *closure;
+  Conversion *conv;
+  FormatKernel kernel;
+  int unit;
+  char buffer[OUTCONV_MAXTEXT];
+} Outconv;
+
+static void *outconv_create(Conversion *conv, Producer child, void *closure)
+{
+  Outconv *this = NEW(Outconv);
+  this->child = child;
+  this->closure = closure;
+  this->conv = conv;
+  this->kernel = outconv_kernel(conv);
+  this->unit = conversion_size(conv);
+  return this;
+}
+
+/*--- Format one binary value at in, returning length of text */
+static int outconv_value(Conversion *conv, const char *in, char *buffer)
+{
+  Uscalar u;
+  int size;
+  int len = 0;
+
+#define GETD(p,n) memcpy(p,in,n)
+
+  switch (conv->type) {
+  case TYPE_CHAR: case TYPE_SHORT: case TYPE_INT: case TYPE_LONG: {
+    long lval = 0;
+    switch (conv->type) {
+    case TYPE_CHAR:
+      size = sizeof(char);
+      GETD(u.bytes, size);
+      if (! conv->unsignedp &&
+	  (conv->style==STYLE_DECIMAL || conv->style == STYLE_DEFAULT)) {
+	lval = (signed char)u.cval;
+      } else {
+	lval = (unsigned char)u.cval;
+      }
+      break;
+    case TYPE_SHORT:
+      size = sizeof(short);
+      GETD(u.bytes, size);
+      if (! conv->unsignedp &&
+	  (conv->style==STYLE_DECIMAL || conv->style == STYLE_DEFAULT)) {
+	lval = (signed short)u.sval;
+      } else {
+	lval = (unsigned short)u.sval;
+      }
+      break;
+    case TYPE_INT:
+      size = sizeof(int);
+      GETD(u.bytes, size);
+      if (! conv->unsignedp &&
+	  (conv->style==STYLE_DECIMAL || conv->style == STYLE_DEFAULT)) {
+	lval = (signed int)u.ival;
+      } else {
+	lval = (unsigned int)u.ival;
+      }
+      break;
+    case TYPE_LONG:
+      size = sizeof(long);
+      GETD(u.bytes, size);
+      lval = u.lval;
+      break;
+    default:;
+    }
+    switch (conv->style) {
+    case STYLE_BINARY:
+      len = format_bin(buffer, lval, size*8, conv->width);
+      break;
+    case STYLE_OCTAL:
+      len = format_oct(buffer, lval, conv->width);
+      break;
+    case STYLE_DEFAULT: case STYLE_DECIMAL:
+      if (! conv->unsignedp && lval < 0) {
+	*buffer = '-';
+	len = 1 + format_dec(buffer+1, -(unsigned long)lval, conv->width);
+      } else {
+	len = format_dec(buffer, lval, conv->width);
+      }
+      break;
+    case STYLE_HEX:
+      len = format_hex(buffer, lval, conv->width);
+      break;
+    }
+  } break;
+  case TYPE_FLOAT:
+    GETD(u.bytes, sizeof(float));
+    len = format_float(buffer, u.fval, conv->precision);
+    break;
+  case TYPE_DOUBLE:
+    GETD(u.bytes, sizeof(double));
+    len = format_double(buffer, u.dval, conv->precision);
+    break;
+#if HAVE_POINT
+  case TYPE_POINT:
+    GETD(u.bytes, sizeof(u.pknam));
+    cdnmupk(u.pknam, buffer, 1);
+    len = strlen(buffer);
+    break;
+#endif
+#if HAVE_BCN
+  case TYPE_BCN: {
+    int b, c, n;
+    GETD(u.bytes, sizeof(short));
+    cmgbcn(u.sval, &b, &c, &n);
+    len = sprintf(buffer, "%d,%d,%d", b, c, n);
+  } break;
+#endif
+#if HAVE_NORDFLOAT
+  case TYPE_NORDFLOAT: {
+    union {
+      double dval;
+      short spart[4];
+    } ieee;
+    GETD(u.nf, 6);
+#ifdef __linux__
+    {
+      /* Assume the "native" byte ordering for Nordfloat is three shorts
+       * in the same order as SunOS but each in native byte-order.
+       */
+      short bigout[4];
+      cf48to64_(u.nf, bigout);
+      ieee.spart[0] = bigout[3];
+      ieee.spart[1] = bigout[2];
+      ieee.spart[2] = bigout[1];
+      ieee.spart[3] = bigout[0];
+    }
+#else
+    cf48to64_(u.nf, ieee.spart);
+#endif
+    len = sprintf(buffer, "%g", ieee.dval);
+  } break;
+#endif
+  case TYPE_DATE: {
+    int64_t t;
+    long nsec, offset;
+    GETD(u.bytes, conversion_size(conv));
+    if (!epoch2date(&u, conv->epoch, &t, &nsec)) {
+      len = format_double(buffer, u.dval, 0);
+      break;
+    }
+    /*--- N.B. ctime/localtime use rules to determine when BST is in
+     * effect, but it seems (on gen-off-8 on 1999-12-14 at least) that
+     * the current ruleset has summer time continuous from the beginning
+     * of time until Autumn 1971,
+     * e.g. "cconv -y 0" yields "Thu Jan  1 01:00:00 1970"
+     */
+    /* "unsigned" overloaded as "UTC" */
+    offset = conv->unsignedp ? 0 : zone_offset(t);
+    if (conv->epoch == EPOCH_SECONDS) {
+      len = format_date(buffer, t + offset);
+    } else {
+      len = format_iso(buffer, t, nsec, epoch_digits[conv->epoch], offset,
+		       conv->unsignedp);
+    }
+  } break;
+  case TYPE_STRING:
+    fail("BUG: variable size type in output converter");
+  }
+#undef GETD
+
+  return len;
+}
+
+/*--- Specialised kernels, as outconv_value for one type and style;
+ * signed only matters for decimal, other styles show the bits */
+#define OUTCONV_INT(type, utype, name)					\
+static int outconv_dec_##name(Conversion *conv, const char *in, char *buf) \
+{									\
+  type v;								\
+  memcpy(&v, in, sizeof(v));						\
+  if (v < 0) {								\
+    *buf = '-';								\
+    return 1 + format_dec(buf + 1, -(unsigned long)(long)v, conv->width); \
+  }									\
+  return format_dec(buf, v, conv->width);				\
+}									\
+static int outconv_udec_##name(Conversion *conv, const char *in, char *buf) \
+{									\
+  utype v;								\
+  memcpy(&v, in, sizeof(v));						\
+  return format_dec(buf, v, conv->width);				\
+}									\
+static int outconv_hex_##name(Conversion *conv, const char *in, char *buf) \
+{									\
+  utype v;								\
+  memcpy(&v, in, sizeof(v));						\
+  return format_hex(buf, v, conv->width);				\
+}									\
+static int outconv_oct_##name(Conversion *conv, const char *in, char *buf) \
+{									\
+  utype v;								\
+  memcpy(&v, in, sizeof(v));						\
+  return format_oct(buf, v, conv->width);				\
+}									\
+static int outconv_bin_##name(Conversion *conv, const char *in, char *buf) \
+{									\
+  utype v;								\
+  memcpy(&v, in, sizeof(v));						\
+  return format_bin(buf, v, sizeof(v)*8, conv->width);			\
+}
+OUTCONV_INT(signed char, unsigned char, char)
+OUTCONV_INT(short, unsigned short, short)
+OUTCONV_INT(int, unsigned int, int)
+OUTCONV_INT(long, unsigned long, long)
+#undef OUTCONV_INT
+
+static int outconv_float(Conversion *conv, const char *in, char *buf)
+{
+  float v;
+  memcpy(&v, in, sizeof(v));
+  return format_float(buf, v, conv->precision);
+}
+
+static int outconv_double(Conversion *conv, const char *in, char *buf)
+{
+  double v;
+  memcpy(&v, in, sizeof(v));
+  return format_double(buf, v, conv->precision);
+}
+
+static FormatKernel outconv_kernel(const Conversion *conv)
+{
+  /*--- Indexed by style: default, binary, octal, decimal, hex */
+#define KERNELS(name) {							\
+    { outconv_dec_##name, outconv_bin_##name, outconv_oct_##name,	\
+      outconv_dec_##name, outconv_hex_##name },			\
+    { outconv_udec_##name, outconv_bin_##name, outconv_oct_##name,	\
+      outconv_udec_##name, outconv_hex_##name } }
+  static const FormatKernel chars[2][5] = KERNELS(char);
+  static const FormatKernel shorts[2][5] = KERNELS(short);
+  static const FormatKernel ints[2][5] = KERNELS(int);
+  static const FormatKernel longs[2][5] = KERNELS(long);
+#undef KERNELS
+  int u = conv->unsignedp ? 1 : 0;
+
+  switch (conv->type) {
+  case TYPE_CHAR:	return chars[u][conv->style];
+  case TYPE_SHORT:	return shorts[u][conv->style];
+  case TYPE_INT:	return ints[u][conv->style];
+  case TYPE_LONG:	return longs[u][conv->style];
+  case TYPE_FLOAT:	return outconv_float;
+  case TYPE_DOUBLE:	return outconv_double;
+  default:		return outconv_value;
+  }
+}
+
+/*--- One value at a time */
+static int outconv_get(void *closure, char **data, int size)
+{
+  Outconv *this = closure;
+  char *str;
+  int num;
+
+  num = this->child(this->closure, &str, this->unit ? this->unit : 1024);
+  if (num < 0) return -1;
+  if (this->conv->type == TYPE_STRING) {
+    *data = str;
+    return num;
+  }
+  *data = this->buffer;
+  return this->kernel(this->conv, str, this->buffer);
+}
+
+/*--- A block of values, formatted directly into the output buffer */
+static int outconv_put_block(void *closure, Output *out)
+{
+  Outconv *this = closure;
+  FormatKernel kernel = this->kernel;
+  Conversion *conv = this->conv;
+  int unit = this->unit;
+  int sep = out->seproom;
+  int num, off, max;
+  char *in, *p;
+
+  max = OUTPUT_SIZE / (OUTCONV_MAXTEXT + sep);
+  if (max > BLOCK_VALUES) max = BLOCK_VALUES;
+  num = this->child(this->closure, &in, max * unit);
+  if (num < 0) return -1;
+  p = output_reserve(out, (num / unit) * (OUTCONV_MAXTEXT + sep));
+  for (off = 0; off + unit <= num; off += unit) {
+    p = output_separate(p, out);
+    p += kernel(conv, in + off, p);
+  }
+  out->len = p - out->buffer;
+  return num;
+}
+
+/*-----------------------------------------------------------------------
+ *	Record layout
+ *	A struct-style layout such as "<ihhhd" describes one packed binary
+ *	record.  It is compiled once into a flat list of fields, each with
+ *	its offset, byte order and a scalar conversion for either side, so
+ *	whole records are parsed or formatted in one pass.
+ *	  first	< little-endian, > or ! big-endian, = native order; or
+ *		@ native order, sizes and alignment, as a C struct
+ *	  b B	8-bit signed/unsigned	h H	16-bit
+ *	  i I l L	32-bit (l L native long with @)	q Q	64-bit
+ *	  f	float			d	double
+ *	  x	pad byte (zero when written, skipped when read)
+ *	A count repeats a code, e.g. "3h", and 0 gives no field; spaces
+ *	are ignored.  Without a first character the order is native, and
+ *	there is no alignment padding except with @, where each field is
+ *	aligned as the compiler would (even with count 0, so "b0i" pads to
+ *	an int).
+ *	As text, each record is one value with fields separated by spaces
+ *	(commas and tabs are also accepted on input).
+ *-----------------------------------------------------------------------*/
+#define RECORD_MAXFIELDS 4096
+
+/*--- Alignment of type in a struct on this platform */
+#define ALIGNOF(type) offsetof(struct { char c; type x; }, x)
+
+typedef struct {
+  int offset;
+  int swap;				/* Not in host byte order */
+  Conversion in, out;			/* Field type with each side's style */
+  ParseKernel parse;
+  FormatKernel format;
+} Field;
+
+typedef struct {
+  int size;				/* Bytes per record */
+  int nfield;
+  Field *field;
+} Layout;
+
+static int host_little(void)
+{
+  static const union { uint16_t s; char c[2]; } host = { 1 };
+  return host.c[0] == 1;
+}
+
+static Layout *layout_compile(const char *spec, const Conversion *inconv,
+			      const Conversion *outconv)
+{
+  Layout *this = NEW(Layout);
+  const char *p = spec;
+  int swap = FALSE, native = FALSE;
+  int count, size, align, nfield = 0;
+  const char *digits;
+  Field *f;
+  Conversion conv;
+
+  switch (*p) {
+  case '<': swap = !host_little(); p++; break;
+  case '>': case '!': swap = host_little(); p++; break;
+  case '=': p++; break;
+  case '@': native = TRUE; p++; break;
+  }
+  this->field = new(RECORD_MAXFIELDS * sizeof(Field));
+  this->size = 0;
+  for (; *p; p++) {
+    if (isspace((unsigned char)*p)) continue;
+    for (digits = p, count = 0; *p >= '0' && *p <= '9'; p++) {
+      count = count * 10 + (*p - '0');
+      if (count > RECORD_MAXFIELDS) fail("Record layout too long: %s", spec);
+    }
+    if (p == digits) count = 1;
+    if (*p == 'F' || *p == 'D' || *p == 'X') {
+      fail("Bad record layout \"%s\" at '%c'", spec, *p);
+    }
+    conv = *outconv;
+    conv.unsignedp = isupper((unsigned char)*p);
+    conv.raw = FALSE;
+    conv.byteswap = FALSE;
+    switch (tolower((unsigned char)*p)) {
+    case 'b':	conv.type = TYPE_CHAR; size = 1; align = 1; break;
+    case 'h':	conv.type = TYPE_SHORT; size = 2; align = ALIGNOF(short); break;
+    case 'i':	conv.type = TYPE_INT; size = 4; align = ALIGNOF(int); break;
+    case 'l':
+      if (native) {
+	conv.type = TYPE_LONG; size = sizeof(long); align = ALIGNOF(long);
+      } else {
+	conv.type = TYPE_INT; size = 4; align = ALIGNOF(int);
+      }
+      break;
+    case 'q':	conv.type = TYPE_LONG; size = 8; align = ALIGNOF(long); break;
+    case 'f':	conv.type = TYPE_FLOAT; size = 4; align = ALIGNOF(float); break;
+    case 'd':	conv.type = TYPE_DOUBLE; size = 8; align = ALIGNOF(double); break;
+    case 'x':
+      this->size += count;
+      continue;
+    default:
+      fail("Bad record layout \"%s\" at '%c'", spec, *p ? *p : ' ');
+    }
+    if (native) {
+      this->size = (this->size + align - 1) / align * align;
+    }
+    if (conversion_size(&conv) != size) {
+      fail("No %d-byte integer for '%c' on this platform", size, *p);
+    }
+    if (nfield + count > RECORD_MAXFIELDS) {
+      fail("Record layout too long: %s", spec);
+    }
+    for (; count > 0; count--) {
+      f = &this->field[nfield++];
+      f->offset = this->size;
+      f->swap = swap && size > 1;
+      f->out = conv;
+      f->in = *inconv;
+      f->in.type = conv.type;
+      f->in.unsignedp = conv.unsignedp;
+      f->in.raw = FALSE;
+      f->in.byteswap = FALSE;
+      f->parse = inconv_kernel(&f->in);
+      f->format = outconv_kernel(&f->out);
+      this->size += size;
+    }
+  }
+  if (this->size == 0) fail("Empty record layout");
+  this->nfield = nfield;
+  return this;
+}
+
+/*--- Text to records */
+typedef struct {
+  Producer child;
+  void *closure;
+  Layout *layout;
+  Inconv *parser;			/* Shared by all fields */
+  char *block;
+  long count;				/* Records read so far */
+} RecordIn;
+
+static void *record_in_create(Layout *layout, Producer child, void *closure)
+{
+  RecordIn *this = NEW(RecordIn);
+  this->child = child;
+  this->closure = closure;
+  this->layout = layout;
+  this->parser = inconv_create(&layout->field[0].in, NULL, NULL);
+  this->block = new(layout->size * BLOCK_VALUES);
+  this->count = 0;
+  return this;
+}
+
+static int record_sep(int c)
+{
+  return c == ' ' || c == ',' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*--- As many whole records as fit in size, up to BLOCK_VALUES */
+static int record_in_get_block(void *closure, char **data, int size)
+{
+  RecordIn *this = closure;
+  Layout *layout = this->layout;
+  int max = size / layout->size;
+  int n = 0, i, len;
+  char *str, *end, *tok, *rec, *value;
+  Field *f;
+
+  if (max < 1) max = 1;
+  if (max > BLOCK_VALUES) max = BLOCK_VALUES;
+  while (n < max && (len = this->child(this->closure, &str, 65536)) >= 0) {
+    end = str + len;
+    while (str < end && record_sep(*str)) str++;
+    if (str == end) continue;		/* Blank line */
+    this->count++;
+    rec = this->block + n * layout->size;
+    memset(rec, 0, layout->size);
+    for (i = 0; i < layout->nfield && str < end; i++) {
+      f = &layout->field[i];
+      for (tok = str; str < end && !record_sep(*str); str++)
+	;
+      this->parser->conv = &f->in;
+      f->parse(this->parser, tok, str - tok, &value);
+      if (f->swap) {
+	swap_scalar(rec + f->offset, value, 1, conversion_size(&f->in));
+      } else {
+	memcpy(rec + f->offset, value, conversion_size(&f->in));
+      }
+      while (str < end && record_sep(*str)) str++;
+    }
+    if (i < layout->nfield || str < end) {
+      fail("Record %ld does not have %d fields", this->count,
+	   layout->nfield);
+    }
+    n++;
+  }
+  if (n == 0) return -1;
+  *data = this->block;
+  return n * layout->size;
+}
+
+/*--- Records to text, formatted directly into the output buffer */
+typedef struct {
+  Producer child;
+  void *closure;
+  Layout *layout;
+} RecordOut;
+
+static void *record_out_create(Layout *layout, Producer child, void *closure)
+{
+  RecordOut *this = NEW(RecordOut);
+  this->child = child;
+  this->closure = closure;
+  this->layout = layout;
+  return this;
+}
+
+static int record_out_put_block(void *closure, Output *out)
+{
+  RecordOut *this = closure;
+  Layout *layout = this->layout;
+  int unit = layout->size;
+  int text = layout->nfield * (OUTCONV_MAXTEXT + 1) + out->seproom;
+  int num, off, i, max;
+  char *in, *p;
+  Field *f;
+  Uscalar u;
+
+  max = OUTPUT_SIZE / text;
+  if (max > BLOCK_VALUES) max = BLOCK_VALUES;
+  num = this->child(this->closure, &in, max * unit);
+  if (num < 0) return -1;
+  p = output_reserve(out, (num / unit) * text);
+  for (off = 0; off + unit <= num; off += unit) {
+    p = output_separate(p, out);
+    for (i = 0; i < layout->nfield; i++) {
+      f = &layout->field[i];
+      if (i > 0) *p++ = ' ';
+      if (f->swap) {
+	swap_scalar(u.bytes, in + off + f->offset, 1, conversion_size(&f->out));
+	p += f->format(&f->out, u.bytes, p);
+      } else {
+	p += f->format(&f->out, in + off + f->offset, p);
+      }
+    }
+  }
+  out->len = p - out->buffer;
+  return num;
+}
+
+/*-----------------------------------------------------------------------
+ *	Aggregation
+ *	Instead of being formatted, values are summed up as count, minimum,
+ *	maximum, sum, mean and (population) standard deviation, and
+ *	optionally counted into nbin equal bins over [lo, hi).  Each block
+ *	is widened to double by the retype kernels and reduced while in
+ *	cache: first count, sum, minimum and maximum, then the squares of
+ *	the differences from the block's mean, which are merged into the
+ *	totals as by Chan et al.  Unlike summing squares this keeps the
+ *	digits of the deviation of values far from zero.  NaNs are only
+ *	counted; longs beyond 2^53 are rounded.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  long n;				/* Values other than NaN */
+  double min, max, sum;
+  double mean, m2;			/* m2: sum of squared deviations */
+} Moments;
+
+typedef struct {
+  RetypeKernel widen;			/* To double, NULL if already */
+  const Conversion *conv;
+  int unit;
+  int integral;				/* Show min, max and sum as integers */
+  Moments total;
+  long nan;
+  int nbin;
+  double lo, hi;
+  long *bin;				/* nbin, then below lo, then above */
+  double *work;
+} Aggregator;
+
+/*--- Count, sum, minimum and maximum of x[i..n) into m */
+static void moments_sum(Moments *m, const double *x, int i, int n)
+{
+  for (; i < n; i++) {
+    if (x[i] != x[i]) continue;
+    m->n++;
+    m->sum += x[i];
+    if (x[i] < m->min) m->min = x[i];
+    if (x[i] > m->max) m->max = x[i];
+  }
+}
+
+/*--- Squared differences of x[i..n) from m's mean into m */
+static void moments_dev(Moments *m, const double *x, int i, int n)
+{
+  double d;
+  for (; i < n; i++) {
+    if (x[i] != x[i]) continue;
+    d = x[i] - m->mean;
+    m->m2 += d * d;
+  }
+}
+
+#if HAVE_SWAP_SIMD
+/*--- SSE2, four values at a time into m; return how many were done.
+ * MINPD and MAXPD give their second operand if either is NaN, so NaNs
+ * are passed over by putting the value first; masks drop them from
+ * the sums. */
+static int moments_sum_sse(Moments *m, const double *x, int n)
+{
+  __m128d lo0, lo1, hi0, hi1, s0, s1, c0, c1, v0, v1, k0, k1;
+  __m128d one = _mm_set1_pd(1.0);
+  double l[2], h[2], s[2], c[2];
+  int i;
+
+  lo0 = lo1 = _mm_set1_pd(INFINITY);
+  hi0 = hi1 = _mm_set1_pd(-INFINITY);
+  s0 = s1 = c0 = c1 = _mm_setzero_pd();
+  for (i = 0; i + 4 <= n; i += 4) {
+    v0 = _mm_loadu_pd(x + i);
+    v1 = _mm_loadu_pd(x + i + 2);
+    k0 = _mm_cmpord_pd(v0, v0);
+    k1 = _mm_cmpord_pd(v1, v1);
+    lo0 = _mm_min_pd(v0, lo0);
+    lo1 = _mm_min_pd(v1, lo1);
+    hi0 = _mm_max_pd(v0, hi0);
+    hi1 = _mm_max_pd(v1, hi1);
+    s0 = _mm_add_pd(s0, _mm_and_pd(v0, k0));
+    s1 = _mm_add_pd(s1, _mm_and_pd(v1, k1));
+    c0 = _mm_add_pd(c0, _mm_and_pd(one, k0));
+    c1 = _mm_add_pd(c1, _mm_and_pd(one, k1));
+  }
+  _mm_storeu_pd(l, _mm_min_pd(lo0, lo1));
+  _mm_storeu_pd(h, _mm_max_pd(hi0, hi1));
+  _mm_storeu_pd(s, _mm_add_pd(s0, s1));
+  _mm_storeu_pd(c, _mm_add_pd(c0, c1));
+  m->n += (long)(c[0] + c[1]);
+  m->sum += s[0] + s[1];
+  m->min = fmin(m->min, fmin(l[0], l[1]));
+  m->max = fmax(m->max, fmax(h[0], h[1]));
+  return i;
+}
+
+static int moments_dev_sse(Moments *m, const double *x, int n)
+{
+  __m128d mean = _mm_set1_pd(m->mean);
+  __m128d q0, q1, d0, d1, v0, v1;
+  double q[2];
+  int i;
+
+  q0 = q1 = _mm_setzero_pd();
+  for (i = 0; i + 4 <= n; i += 4) {
+    v0 = _mm_loadu_pd(x + i);
+    v1 = _mm_loadu_pd(x + i + 2);
+    d0 = _mm_and_pd(_mm_sub_pd(v0, mean), _mm_cmpord_pd(v0, v0));
+    d1 = _mm_and_pd(_mm_sub_pd(v1, mean), _mm_cmpord_pd(v1, v1));
+    q0 = _mm_add_pd(q0, _mm_mul_pd(d0, d0));
+    q1 = _mm_add_pd(q1, _mm_mul_pd(d1, d1));
+  }
+  _mm_storeu_pd(q, _mm_add_pd(q0, q1));
+  m->m2 += q[0] + q[1];
+  return i;
+}
+#endif
+
+static void moments_clear(Moments *m)
+{
+  m->n = 0;
+  m->min = INFINITY;
+  m->max = -INFINITY;
+  m->sum = m->mean = m->m2 = 0.0;
+}
+
+/*--- Count, sum, minimum and maximum of n values at x into m */
+static void moments_add(Moments *m, const double *x, int n)
+{
+  int i = 0;
+#if HAVE_SWAP_SIMD
+  i = moments_sum_sse(m, x, n);
+#endif
+  moments_sum(m, x, i, n);
+}
+
+/*--- Moments of n values at x */
+static void moments_block(Moments *m, const double *x, int n)
+{
+  int i = 0;
+  moments_clear(m);
+  moments_add(m, x, n);
+  if (m->n == 0) return;
+  m->mean = m->sum / m->n;
+#if HAVE_SWAP_SIMD
+  i = moments_dev_sse(m, x, n);
+#endif
+  moments_dev(m, x, i, n);
+}
+
+/*--- Add the moments of b to those of all before, in total */
+static void moments_merge(Moments *total, const Moments *b)
+{
+  long n = total->n + b->n;
+  double delta;
+  if (b->n == 0) return;
+  if (total->n == 0) {
+    *total = *b;
+    return;
+  }
+  delta = b->mean - total->mean;
+  total->m2 += b->m2 + delta * delta * ((double)total->n * b->n / n);
+  total->mean += delta * b->n / n;
+  total->sum += b->sum;
+  if (b->min < total->min) total->min = b->min;
+  if (b->max > total->max) total->max = b->max;
+  total->n = n;
+}
+
+/*--- n values at in as doubles, widened into work unless already */
+static const double *widen_block(RetypeKernel widen, const Conversion *conv,
+				 double *work, const char *in, int n)
+{
+  if (widen) {
+    widen((char *)work, in, n, conv);
+    return work;
+  } else if ((uintptr_t)in % sizeof(double) == 0) {
+    return (const double *)in;
+  } else {
+    memcpy(work, in, n * sizeof(double));
+    return work;
+  }
+}
+
+static Aggregator *aggregator_create(const Conversion *conv,
+				     const CconvOptions *opt)
+{
+  Aggregator *this = NEW(Aggregator);
+  int kind = retype_kind(conv);
+
+  if (kind < 0) {
+    fail("--aggregate needs a numeric type");
+  }
+  this->widen = kind == RETYPE_DOUBLE ? NULL :
+    retype_kernels[kind * RETYPE_KINDS + RETYPE_DOUBLE];
+  this->conv = conv;
+  this->unit = conversion_size(conv);
+  this->integral = kind < RETYPE_FLOAT;
+  memset(&this->total, 0, sizeof(this->total));
+  this->nan = 0;
+  this->nbin = opt->nbin;
+  this->lo = opt->lo;
+  this->hi = opt->hi;
+  this->bin = NULL;
+  if (this->nbin > 0) {
+    if (!(this->lo < this->hi)) {
+      fail("Histogram needs a low bound below the high");
+    }
+    this->bin = new((this->nbin + 2) * sizeof(long));
+    memset(this->bin, 0, (this->nbin + 2) * sizeof(long));
+  }
+  this->work = new(BLOCK_VALUES * sizeof(double));
+  return this;
+}
+
+/*--- Count each of x[0..n) into its bin */
+static void aggregator_bin(Aggregator *this, const double *x, int n)
+{
+  double scale = this->nbin / (this->hi - this->lo);
+  long b;
+  int i;
+  for (i = 0; i < n; i++) {
+    if (x[i] < this->lo) {
+      this->bin[this->nbin]++;
+    } else if (x[i] >= this->hi) {
+      this->bin[this->nbin + 1]++;
+    } else if (x[i] == x[i]) {
+      b = (x[i] - this->lo) * scale;
+      this->bin[b < this->nbin ? b : this->nbin - 1]++;
+    }
+  }
+}
+
+/*--- Add n whole values at in */
+static void aggregator_add(Aggregator *this, const char *in, int n)
+{
+  const double *x;
+  Moments m;
+  int k;
+
+  for (; n > 0; n -= k, in += k * this->unit) {
+    k = n < BLOCK_VALUES ? n : BLOCK_VALUES;
+    x = widen_block(this->widen, this->conv, this->work, in, k);
+    moments_block(&m, x, k);
+    moments_merge(&this->total, &m);
+    this->nan += k - m.n;
+    if (this->nbin > 0) aggregator_bin(this, x, k);
+  }
+}
+
+/*--- Number val as text: integers in full, others by precision */
+static int aggregator_number(char *buf, double val, int integral,
+			     int precision)
+{
+  if (!isfinite(val)) return sprintf(buf, "%g", val);
+  if (integral) return sprintf(buf, "%.0f", val);
+  return format_double(buf, val, precision ? precision : PRECISION_SHORTEST);
+}
+
+/*--- Name, tab and value, as one output value */
+static void aggregator_line(Output *out, const char *name, double val,
+			    int integral, int precision)
+{
+  char buf[512];
+  int len = sprintf(buf, "%s\t", name);
+  len += aggregator_number(buf + len, val, integral, precision);
+  output_value(out, buf, len);
+}
+
+/*--- The summary, then a line per bin: from, to and count */
+static void aggregator_report(Aggregator *this, Output *out, int precision)
+{
+  Moments *t = &this->total;
+  int integral = this->integral;
+  char buf[512];
+  int len, i;
+
+  if (t->n == 0) {
+    t->min = t->max = t->mean = t->m2 = NAN;
+  }
+  aggregator_line(out, "count", t->n, TRUE, precision);
+  if (!integral) aggregator_line(out, "nan", this->nan, TRUE, precision);
+  aggregator_line(out, "min", t->min, integral, precision);
+  aggregator_line(out, "max", t->max, integral, precision);
+  aggregator_line(out, "sum", t->sum, integral, precision);
+  aggregator_line(out, "mean", t->mean, FALSE, precision);
+  aggregator_line(out, "stddev", sqrt(t->m2 / t->n), FALSE, precision);
+  if (this->nbin == 0) return;
+  aggregator_line(out, "below", this->bin[this->nbin], TRUE, precision);
+  for (i = 0; i < this->nbin; i++) {
+    len = sprintf(buf, "bin\t");
+    len += aggregator_number(buf + len, this->lo + (this->hi - this->lo) *
+			     i / this->nbin, FALSE, precision);
+    buf[len++] = '\t';
+    len += aggregator_number(buf + len, i + 1 == this->nbin ? this->hi :
+			     this->lo + (this->hi - this->lo) * (i + 1) /
+			     this->nbin, FALSE, precision);
+    len += sprintf(buf + len, "\t%ld", this->bin[i]);
+    output_value(out, buf, len);
+  }
+  aggregator_line(out, "above", this->bin[this->nbin + 1], TRUE, precision);
+}
+
+/*-----------------------------------------------------------------------
+ *	Decimation
+ *	Each bucket of size values becomes its minimum and maximum, and
+ *	mean if asked for, so that a plot of the result has the same
+ *	envelope as one of all values.  The values are widened to double,
+ *	reduced by the aggregation kernels, and converted on to the output
+ *	type by the rules of retyping.  NaNs are passed over; a bucket of
+ *	only NaNs gives NaNs.  The last bucket may be short.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  Producer child;
+  void *closure;
+  const Conversion *inconv, *outconv;
+  RetypeKernel widen, narrow;		/* To double and back, or NULL */
+  int inunit, outunit;
+  long size;				/* Values per bucket */
+  int mean;
+  long taken;				/* Values in bucket so far */
+  Moments bucket;
+  double *work;				/* Widened values */
+  double *result;			/* Of buckets done, as double */
+  char *buffer;				/* And as output type */
+} Decimator;
+
+static void *decimator_create(const Conversion *inconv,
+			      const Conversion *outconv,
+			      const CconvOptions *opt, Producer child,
+			      void *closure)
+{
+  Decimator *this = NEW(Decimator);
+  int from = retype_kind(inconv), to = retype_kind(outconv);
+
+  if (from < 0 || to < 0) {
+    fail("--decimate and --points need numeric types");
+  }
+  this->child = child;
+  this->closure = closure;
+  this->inconv = inconv;
+  this->outconv = outconv;
+  this->widen = from == RETYPE_DOUBLE ? NULL :
+    retype_kernels[from * RETYPE_KINDS + RETYPE_DOUBLE];
+  this->narrow = to == RETYPE_DOUBLE ? NULL :
+    retype_kernels[RETYPE_DOUBLE * RETYPE_KINDS + to];
+  this->inunit = conversion_size(inconv);
+  this->outunit = conversion_size(outconv);
+  this->size = opt->decimate;
+  this->mean = opt->mean;
+  this->taken = 0;
+  moments_clear(&this->bucket);
+  this->work = new(BLOCK_VALUES * sizeof(double));
+  this->result = new(3 * BLOCK_VALUES * sizeof(double));
+  this->buffer = new(3 * BLOCK_VALUES * this->outunit);
+  return this;
+}
+
+/*--- Values of the bucket done to r, returning the end of them */
+static double *decimator_bucket(Decimator *this, double *r)
+{
+  Moments *b = &this->bucket;
+  if (b->n == 0) {
+    b->min = b->max = NAN;
+  }
+  *r++ = b->min;
+  *r++ = b->max;
+  if (this->mean) *r++ = b->n ? b->sum / b->n : NAN;
+  moments_clear(b);
+  this->taken = 0;
+  return r;
+}
+
+/*--- The values of one or more whole buckets */
+static int decimator_get(void *closure, char **data, int size)
+{
+  Decimator *this = closure;
+  double *r = this->result;
+  const double *x;
+  int num, n, i, k;
+  char *in;
+
+  do {
+    num = this->child(this->closure, &in, BLOCK_VALUES * this->inunit);
+    if (num < 0) {
+      if (this->taken == 0) return -1;
+      r = decimator_bucket(this, r);
+      break;
+    }
+    n = num / this->inunit;
+    x = widen_block(this->widen, this->inconv, this->work, in, n);
+    for (i = 0; i < n; i += k) {
+      k = this->size - this->taken < n - i ? this->size - this->taken : n - i;
+      moments_add(&this->bucket, x + i, k);
+      this->taken += k;
+      if (this->taken == this->size) r = decimator_bucket(this, r);
+    }
+  } while (r == this->result);
+
+  n = r - this->result;
+  if (this->narrow) {
+    this->narrow(this->buffer, (const char *)this->result, n, this->outconv);
+    *data = this->buffer;
+  } else {
+    *data = (char *)this->result;
+  }
+  return n * this->outunit;
+}
+
+/*-----------------------------------------------------------------------
+ *	Parallel conversion of a mapped raw file
+ *	The data is split into chunks of whole values, which worker threads
+ *	format into a ring of slots while the main thread writes the slots
+ *	out in order.  Workers may run at most nslot chunks ahead of output.
+ *-----------------------------------------------------------------------*/
+#define CHUNK_VALUES 16384
+
+typedef struct {
+  char *text;
+  int len;
+  int size;
+  int ready;
+} Slot;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;			/* Slot filled or freed */
+  const char *data;
+  size_t len;
+  size_t chunk;				/* Bytes per chunk */
+  long nchunk;
+  long next;				/* Next chunk to convert */
+  long written;				/* Chunks written out */
+  int nslot;
+  Slot *slots;
+  Conversion *inconv, *outconv;
+  FormatKernel format;
+  Output *out;
+} Jobs;
+
+static int gcd(int a, int b)
+{
+  return b == 0 ? a : gcd(b, a % b);
+}
+
+/*--- Format chunk k into its slot, using scratch for swapping/padding */
+static void jobs_convert(Jobs *this, long k, char *scratch)
+{
+  Slot *slot = &this->slots[k % this->nslot];
+  int unit = conversion_size(this->outconv);
+  int inwidth = conversion_swapsize(this->inconv);
+  int outwidth = conversion_swapsize(this->outconv);
+  int seplen = this->out->seproom;
+  size_t off = k * this->chunk;
+  int bytes = (this->len - off < this->chunk) ? this->len - off : this->chunk;
+  const char *in = this->data + off;
+  char *p;
+  long first;
+  int n, i, need;
+
+  if (this->inconv->byteswap && inwidth > 0) {
+    n = bytes / inwidth;
+    swap_block(scratch, in, n, inwidth);
+    memcpy(scratch + n*inwidth, in + n*inwidth, bytes - n*inwidth);
+    in = scratch;
+  }
+  if (bytes % unit != 0) {		/* Last chunk: pad final value */
+    if (in != scratch) memcpy(scratch, in, bytes);
+    memset(scratch + bytes, 0, unit - bytes % unit);
+    bytes += unit - bytes % unit;
+    in = scratch;
+  }
+  n = bytes / unit;
+  if (this->outconv->byteswap) {
+    swap_block(scratch, in, n * unit / outwidth, outwidth);
+    in = scratch;
+  }
+
+  need = n * (OUTCONV_MAXTEXT + seplen);
+  if (need > slot->size) {
+    release(slot->text);
+    slot->text = new(slot->size = need);
+  }
+  p = slot->text;
+  first = off / unit;
+  for (i = 0; i < n; i++) {
+    p = output_sep_at(this->out, p, first + i);
+    p += this->format(this->outconv, in + i*unit, p);
+  }
+  slot->len = p - slot->text;
+}
+
+static void *jobs_worker(void *closure)
+{
+  Jobs *this = closure;
+  char *scratch = new(this->chunk + sizeof(Uscalar));
+  long k;
+
+  pthread_mutex_lock(&this->lock);
+  for (;;) {
+    while (this->next < this->nchunk &&
+	   this->next >= this->written + this->nslot) {
+      pthread_cond_wait(&this->cond, &this->lock);
+    }
+    if (this->next >= this->nchunk) break;
+    k = this->next++;
+    pthread_mutex_unlock(&this->lock);
+
+    jobs_convert(this, k, scratch);
+
+    pthread_mutex_lock(&this->lock);
+    this->slots[k % this->nslot].ready = TRUE;
+    pthread_cond_broadcast(&this->cond);
+  }
+  pthread_mutex_unlock(&this->lock);
+  release(scratch);
+  return NULL;
+}
+
+static void jobs_run(int njob, const char *data, size_t len,
+		     Conversion *inconv, Conversion *outconv, Output *out)
+{
+  Jobs *this = NEW(Jobs);
+  pthread_t *threads = new(njob * sizeof(pthread_t));
+  int unit = conversion_size(outconv);
+  int inunit = conversion_size(inconv);
+  int align = unit;
+  int i;
+  long k;
+  Slot *slot;
+
+  /*--- Chunks hold whole values of both input and output types */
+  if (inconv->byteswap && inunit > 0) {
+    align = unit / gcd(unit, inunit) * inunit;
+  }
+  pthread_mutex_init(&this->lock, NULL);
+  pthread_cond_init(&this->cond, NULL);
+  this->data = data;
+  this->len = len;
+  this->chunk = (size_t)align * CHUNK_VALUES;
+  this->nchunk = (len + this->chunk - 1) / this->chunk;
+  this->next = 0;
+  this->written = 0;
+  this->nslot = 2 * njob;
+  this->slots = new(this->nslot * sizeof(Slot));
+  memset(this->slots, 0, this->nslot * sizeof(Slot));
+  this->inconv = inconv;
+  this->outconv = outconv;
+  this->format = outconv_kernel(outconv);
+  this->out = out;
+
+  swap_block(NULL, NULL, 0, 1);		/* Choose kernel before threads */
+  for (i = 0; i < njob; i++) {
+    if (pthread_create(&threads[i], NULL, jobs_worker, this) != 0) {
+      fail("Cannot create thread");
+    }
+  }
+  for (k = 0; k < this->nchunk; k++) {
+    slot = &this->slots[k % this->nslot];
+    pthread_mutex_lock(&this->lock);
+    while (!slot->ready) {
+      pthread_cond_wait(&this->cond, &this->lock);
+    }
+    pthread_mutex_unlock(&this->lock);
+
+    output_write(out, slot->text, slot->len);
+
+    pthread_mutex_lock(&this->lock);
+    slot->ready = FALSE;
+    this->written++;
+    pthread_cond_broadcast(&this->cond);
+    pthread_mutex_unlock(&this->lock);
+  }
+  for (i = 0; i < njob; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  out->count = (len + unit - 1) / unit;
+  for (i = 0; i < this->nslot; i++) {
+    release(this->slots[i].text);	/* Allocated by the workers */
+  }
+}
+
+/*-----------------------------------------------------------------------
+ *	Memory producer for the library
+ *	Raw data is handed out in blocks as asked for, text a line at a
+ *	time from a NUL-terminated copy, so parsing stops at its end.
+ *-----------------------------------------------------------------------*/
+typedef struct {
+  char *data;
+  long len;
+  long pos;
+  int raw;
+} MemStream;
+
+static void *mem_create(const char *src, long len, int raw)
+{
+  MemStream *this = NEW(MemStream);
+  if (raw) {
+    this->data = (char *)src;
+  } else {
+    this->data = new(len + 1);
+    memcpy(this->data, src, len);
+    this->data[len] = '\0';
+  }
+  this->len = len;
+  this->pos = 0;
+  this->raw = raw;
+  return this;
+}
+
+static int mem_get(void *closure, char **data, int size)
+{
+  MemStream *this = closure;
+  char *nl;
+  long num = this->len - this->pos;
+  if (num <= 0) return -1;
+  if (this->raw) {
+    if (num > size) num = size;
+  } else if ((nl = memchr(this->data + this->pos, '\n', num)) != NULL) {
+    num = nl + 1 - (this->data + this->pos);
+  }
+  if (num > INT_MAX) fail("Line of over %d bytes", INT_MAX);
+  *data = this->data + this->pos;
+  this->pos += num;
+  return num;
+}
+
+/*-----------------------------------------------------------------------
+ *	Running a conversion
+ *	The stages are chained from the source: splitter, input conversion
+ *	or records, byte-swapping, reducer, then back out through the
+ *	output conversion into an Output.
+ *-----------------------------------------------------------------------*/
+void cconv_options_init(CconvOptions *opt)
+{
+  memset(opt, 0, sizeof(*opt));
+  opt->njob = 1;
+}
+
+/*--- Values per line as asked, else a bucket's when decimating */
+static int cconv_perline(const CconvOptions *opt)
+{
+  if (opt->perline || opt->sep || !(opt->decimate || opt->points)) {
+    return opt->perline;
+  }
+  return opt->mean ? 3 : 2;
+}
+
+static const char *cconv_sep(const CconvOptions *opt)
+{
+  if (opt->sep != NULL) return opt->sep;
+  return cconv_perline(opt) ? " " : "\n";
+}
+
+/*--- opt, or for points a copy in local with the bucket size to reach
+ * it from bytes of raw input (-1 if not known) */
+static const CconvOptions *cconv_points(const CconvOptions *opt,
+					const Conversion *inconv, long bytes,
+					CconvOptions *local)
+{
+  long n;
+  if (opt->decimate || !opt->points) return opt;
+  if (!inconv->raw || bytes < 0 || conversion_size(inconv) == 0) {
+    fail("--points needs raw input from a file or memory");
+  }
+  n = bytes / conversion_size(inconv);
+  n = n > opt->first ? n - opt->first : 0;
+  if (opt->stride > 1) n = (n + opt->stride - 1) / opt->stride;
+  if (opt->count && n > opt->count) n = opt->count;
+  *local = *opt;
+  local->decimate = n > opt->points ? (n + opt->points - 1) / opt->points : 1;
+  return local;
+}
+
+static void cconv_pipe(Producer prod, void *stream, Conversion *inconv,
+		       Conversion *outconv, Layout *layout,
+		       const CconvOptions *opt, Output *out, Stats *stats)
+{
+  int inunit = layout ? layout->size : conversion_size(inconv);
+  int outunit = layout ? layout->size : conversion_size(outconv);
+  RetypeKernel retype;
+  Aggregator *agg;
+  Stage sink;
+  long long t = 0;
+  char *str;
+  int num;
+
+  if (layout && opt->nchannel) {
+    fail("--scale and --offset do not apply to --record");
+  }
+  if (layout && (opt->aggregate || opt->decimate)) {
+    fail("--aggregate and --decimate do not apply to --record");
+  }
+  meter(stats, "read", inconv->raw ? inunit : 0, &prod, &stream);
+  if (inconv->raw && selecting(opt)) {
+    /*--- Chosen values only, before anything is done to them */
+    if (inunit) {
+      stream = expander_create(inunit, FALSE, prod, stream);
+      prod = expander_get;
+    }
+    selector_add(opt, inunit, stats, &prod, &stream);
+  }
+  if (opt->split && !inconv->raw && !layout) {
+    /*--- Many values per line or argument */
+    stream = splitter_create(prod, stream);
+    prod = splitter_get;
+    meter(stats, "split", 0, &prod, &stream);
+  }
+
+  if (layout) {
+    /*--- Whole records, parsed from text unless already binary */
+    if (!inconv->raw) {
+      stream = record_in_create(layout, prod, stream);
+      prod = record_in_get_block;
+      meter(stats, "parse", inunit, &prod, &stream);
+      selector_add(opt, inunit, stats, &prod, &stream);
+    }
+  } else if (inconv->raw) {
+    /*--- Byte-swap whole values of input type if asked */
+    if (inconv->byteswap && inunit) {
+      stream = expander_create(inunit, FALSE, prod, stream);
+      stream = swapper_create(conversion_swapsize(inconv), expander_get, stream);
+      prod = swapper_get;
+      meter(stats, "swap", inunit, &prod, &stream);
+    }
+    /*--- Straight to the output type, whether raw or to be formatted */
+    if (!opt->nchannel && !opt->decimate && !opt->aggregate &&
+	(retype = retype_kernel(inconv, outconv)) != NULL) {
+      if (!inconv->byteswap) {
+	stream = expander_create(inunit, FALSE, prod, stream);
+	prod = expander_get;
+      }
+      stream = retyper_create(retype, inconv, outconv, prod, stream);
+      prod = retyper_get;
+      inunit = outunit;			/* Values now of output type */
+      meter(stats, "retype", inunit, &prod, &stream);
+    }
+  } else {
+    /*--- Apply input conversion, batched unless variable size */
+    stream = inconv_create(inconv, prod, stream);
+    if (inunit && (outconv->raw || outconv->type != TYPE_STRING)) {
+      prod = inconv_get_block;
+      meter(stats, "parse", inunit, &prod, &stream);
+    } else {
+      prod = inconv_get;
+      meter(stats, "parse", 0, &prod, &stream);
+    }
+    selector_add(opt, inunit, stats, &prod, &stream);
+    if (inconv->byteswap && inunit) {
+      stream = swapper_create(conversion_swapsize(inconv), prod, stream);
+      prod = swapper_get;
+      meter(stats, "swap", inunit, &prod, &stream);
+    }
+  }
+
+  if (opt->nchannel) {
+    /*--- Calibrated values, of the output type */
+    if (inconv->raw && !inconv->byteswap) {
+      stream = expander_create(inunit, FALSE, prod, stream);
+      prod = expander_get;
+    }
+    stream = calibrator_create(inconv, outconv, opt, prod, stream);
+    prod = calibrator_get;
+    inunit = outunit;
+    meter(stats, "calibrate", inunit, &prod, &stream);
+  }
+
+  if (opt->decimate) {
+    /*--- Buckets of whole values to their extremes, of the output type */
+    stream = expander_create(inunit, FALSE, prod, stream);
+    stream = decimator_create(opt->nchannel ? outconv : inconv, outconv, opt,
+			      expander_get, stream);
+    prod = decimator_get;
+    inunit = outunit;
+    meter(stats, "decimate", inunit, &prod, &stream);
+  }
+
+  /*--- Data produced can have variable sizes; truncate to what asked for */
+  stream = reducer_create(prod, stream);
+  prod = reducer_get;
+  meter(stats, "reduce", inunit, &prod, &stream);
+
+  if (stats) {
+    /*--- Last stage, timed as a whole, with the writes inside it */
+    memset(&sink, 0, sizeof(sink));
+    sink.name = opt->aggregate ? "aggregate" :
+      outconv->raw ? "copy" : "format";
+    sink.unit = opt->aggregate ? inunit : outunit;
+    out->stats = &stats->write;
+    t = stats_now();
+  }
+  if (opt->aggregate) {
+    /*--- Summary of whole values, of the input type unless calibrated */
+    agg = aggregator_create(opt->nchannel || opt->decimate ? outconv : inconv,
+			    opt);
+    stream = expander_create(inunit, FALSE, prod, stream);
+    prod = expander_get;
+    while ((num = prod(stream, &str, BLOCK_VALUES * inunit)) >= 0) {
+      aggregator_add(agg, str, num / inunit);
+      if (stats) stats_count(&sink, num);
+    }
+    aggregator_report(agg, out, outconv->precision);
+    output_finish(out);
+  } else if (layout && !outconv->raw) {
+    /*--- One record per value */
+    stream = expander_create(layout->size, TRUE, prod, stream);
+    prod = expander_get;
+    meter(stats, "expand", outunit, &prod, &stream);
+    stream = record_out_create(layout, prod, stream);
+    while ((num = record_out_put_block(stream, out)) >= 0) {
+      if (stats) stats_count(&sink, num);
+    }
+    output_finish(out);
+  } else if (outconv->raw) {
+    if (outconv->byteswap && outunit) {
+      stream = expander_create(outunit, FALSE, prod, stream);
+      stream = swapper_create(conversion_swapsize(outconv), expander_get, stream);
+      prod = swapper_get;
+      meter(stats, "swap", outunit, &prod, &stream);
+    }
+    while ((num = prod(stream, &str, 65536)) >= 0) {
+      output_write(out, str, num);
+      if (stats) stats_count(&sink, num);
+    }
+    output_flush(out);
+  } else if (outconv->type == TYPE_STRING) {
+    /*--- Strings have no fixed size, so go one at a time */
+    stream = outconv_create(outconv, prod, stream);
+    prod = outconv_get;
+
+    while ((num = prod(stream, &str, 1024)) >= 0) {
+      output_value(out, str, strnlen(str, num));
+      if (stats) stats_count(&sink, num);
+    }
+    output_finish(out);
+  } else {
+    /*--- Pad to whole values of required size */
+    stream = expander_create(outunit, TRUE, prod, stream);
+    prod = expander_get;
+    if (outconv->byteswap) {
+      stream = swapper_create(conversion_swapsize(outconv), prod, stream);
+      prod = swapper_get;
+    }
+    meter(stats, outconv->byteswap ? "swap" : "expand", outunit,
+	  &prod, &stream);
+
+    /*--- Convert blocks straight into the output buffer */
+    stream = outconv_create(outconv, prod, stream);
+    while ((num = outconv_put_block(stream, out)) >= 0) {
+      if (stats) stats_count(&sink, num);
+    }
+    output_finish(out);
+  }
+  if (stats) {
+    /*--- Added last, so its own time excludes the stages below */
+    sink.ns = stats_now() - t;
+    sink.bytes = out->written;
+    *stats_stage(stats, sink.name, sink.unit) = sink;
+  }
+}
+
+int cconv_run(Conversion *inconv, Conversion *outconv, const CconvOptions *opt)
+{
+  CconvOptions local;
+  FileStream *file = NULL;
+  Layout *layout = NULL;
+  Stats *stats = NULL;
+  Stage *stage;
+  Output *out;
+  Producer prod;
+  void *stream;
+
+  pool_begin();
+  if (opt->stats != STATS_NONE) stats = stats_create();
+  if (opt->record) layout = layout_compile(opt->record, inconv, outconv);
+  if (opt->infile) {
+    stream = file = file_create(opt->infile, inconv->raw);
+    file_skip(file, opt->skip);
+    if (inconv->raw) {
+      prod = file_get_raw;
+    } else {
+      prod = file_get;
+    }
+  } else {
+    stream = argv_create(opt->argc, opt->argv);
+    prod = argv_get;
+  }
+
+  opt = cconv_points(opt, inconv, file && file->map ?
+		     (long)(file->maplen - file->mappos) : -1, &local);
+  out = output_create(STDOUT_FILENO, cconv_sep(opt), cconv_perline(opt));
+  if (opt->njob > 1 && file != NULL && file->map != NULL && !layout &&
+      !outconv->raw && conversion_size(outconv) > 0 && !opt->nchannel &&
+      !selecting(opt) && !opt->decimate && !opt->aggregate &&
+      retype_kernel(inconv, outconv) == NULL) {
+    /*--- Whole raw file in memory: convert chunks in parallel */
+    if (stats) out->stats = &stats->write;
+    jobs_run(opt->njob, file->map + file->mappos, file->maplen - file->mappos,
+	     inconv, outconv, out);
+    output_finish(out);
+    if (stats) {
+      /*--- Only as a whole, as the workers are not metered */
+      stage = stats_stage(stats, "jobs", 0);
+      stage->calls = 1;
+      stage->values = out->count;
+      stage->bytes = out->written;
+      stage->ns = stats_now() - stats->start;
+    }
+  } else {
+    cconv_pipe(prod, stream, inconv, outconv, layout, opt, out, stats);
+  }
+  if (stats) stats_report(stats, opt->stats);
+  if (file) file_close(file);
+  pool_end();
+  return 0;
+}
+
+long cconv_convert(const char *src, long srclen, Conversion *inconv,
+		   char *dst, long dstsize, Conversion *outconv,
+		   const CconvOptions *opt)
+{
+  CconvOptions defaults, local;
+  Layout *layout = NULL;
+  Output *out;
+  long len, skip;
+
+  if (opt == NULL) {
+    cconv_options_init(&defaults);
+    opt = &defaults;
+  }
+  pool_begin();
+  if (opt->record) layout = layout_compile(opt->record, inconv, outconv);
+  if (opt->skip > 0) {
+    skip = opt->skip < srclen ? opt->skip : srclen;
+    src += skip;
+    srclen -= skip;
+  }
+  opt = cconv_points(opt, inconv, srclen, &local);
+  out = output_create(-1, cconv_sep(opt), cconv_perline(opt));
+  out->mem = dst;
+  out->memsize = dstsize;
+  cconv_pipe(mem_get, mem_create(src, srclen, inconv->raw), inconv, outconv,
+	     layout, opt, out, NULL);
+  len = out->overflow ? -1 : out->memlen;
+  pool_end();
+  return len;
+}
+
+/*-----------------------------------------------------------------------
+ *	Memory allocator
+ *	Between pool_begin and pool_end, what a thread allocates is freed
+ *	all at once at the end, so a conversion run from the library
+ *	leaves nothing behind; release is then a no-op.  Otherwise release
+ *	frees at once.
+ *-----------------------------------------------------------------------*/
+typedef union Mem {
+  struct {
+    union Mem *next;
+    int pooled;
+  } h;
+  long double align;
+} Mem;
+
+static THREAD_LOCAL Mem *mem_pool;
+static THREAD_LOCAL int mem_pooling;
+
+static void *new(size_t size)
+{
+  Mem *this;
+  this = size > SIZE_MAX - sizeof(Mem) ? NULL : malloc(sizeof(Mem) + size);
+  if (this == NULL) {
+    fprintf(stderr, "%s: Out of memory\n", cconv_progname);
+    exit(1);
+  }
+  this->h.pooled = mem_pooling;
+  if (mem_pooling) {
+    this->h.next = mem_pool;
+    mem_pool = this;
+  }
+  return this + 1;
+}
+
+static void release(void *ptr)
+{
+  Mem *this;
+  if (ptr == NULL) return;
+  this = (Mem *)ptr - 1;
+  if (!this->h.pooled) free(this);
+}
+
+static void pool_begin(void)
+{
+  mem_pooling = TRUE;
+}
+
+static void pool_end(void)
+{
+  Mem *next;
+  for (; mem_pool != NULL; mem_pool = next) {
+    next = mem_pool->h.next;
+    free(mem_pool);
+  }
+  mem_pooling = FALSE;
+}
+
+static void fail(const char *fmt, ...)
+{
+  va_list ap;
+  char msg[1024];
+  va_start(ap,fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  if (cconv_fail != NULL) {
+    cconv_fail(msg);
+  }
+  fprintf(stderr, "%s: %s\n", cconv_progname, msg);
+  exit(1);
+}
+
+#ifdef __sunos5__
+static uint16_t
+bswap16(uint16_t x)
+{
+  union {
+    uint16_t v;
+    char b[2];
+  } in, out;
+  in.v = x;
+  out.b[0] = in.b[1];
+  out.b[1] = in.b[0];
+  return out.v;
+}
+
+static uint32_t
+bswap32(uint32_t x)
+{
+  union {
+    uint32_t v;
+    char b[4];
+  } in, out;
+  in.v = x;
+  out.b[0] = in.b[3];
+  out.b[1] = in.b[2];
+  out.b[2] = in.b[1];
+  out.b[3] = in.b[0];
+  return out.v;
+}
+
+static uint64_t
+bswap64(uint64_t x)
+{
+  union {
+    uint64_t v;
+    char b[2];
+  } in, out;
+  in.v = x;
+  out.b[0] = in.b[7];
+  out.b[1] = in.b[6];
+  out.b[2] = in.b[5];
+  out.b[3] = in.b[4];
+  out.b[4] = in.b[3];
+  out.b[5] = in.b[2];
+  out.b[6] = in.b[1];
+  out.b[7] = in.b[0];
+  return out.v;
+}
+
+#endif
+
+#if NOTYET
+int shell_unquote(char *s, char *dest)
+{
+  int c;
+  char *d = dest;
+  for (;;) {
+    c = *s++;
+    if (c == 0) {
+      break;
+    } else if (c == '\'') {
+      for (;;) {
+	c = *s++;
+	if (c == 0) break;
+	if (c == '\'') {
+	  break;
+	} else {
+	  *d++ = c;
+	}
+      }
+      if (c == 0) break;
+    } else if (c == '"') {
+      for (;;) {
+	c = *s++;
+	if (c == 0) break;
+	if (c == '"') {
+	  break;
+	} else if (c == '\\') {
+	  c = *s++;
+	  if (c == 0) break;
+	  if (c != '"' && c != '\\') {
+	    *d++ = '\\';
+	  }
+	  *d++ = c;
+	} else {
+	  *d++ = c;
+	}
+      }
+      if (c == 0) break;
+    } else if (c == '\\') {
+      c = *s++;
+      if (c == 0) break;
+      *d++ = c;
+    } else {
+      *d++ = c;
+    }
+  }
+  num = d - dest;
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*=======================================================================
+ *	Convert values between text and binary representations
+ *	Interface to the conversions done by cconv.  Each side of a
+ *	conversion is described by a Conversion, as set by cconv's options
+ *	(see cconv.c); values are then converted either from a file or
+ *	strings to stdout, as the cconv command does, or from one memory
+ *	buffer to another.
+ *	Link with libcconv.a, -pthread and -lm.
+ *=======================================================================*/
+#ifndef LIBCCONV_H
+#define LIBCCONV_H
+
+#include <time.h>
+
+#ifdef __sunos5__
+# define HAVE_NORDFLOAT 1
+# define HAVE_POINT 1
+# define HAVE_BCN 1
+#endif
+
+/*-----------------------------------------------------------------------
+ *	Conversion control
+ *-----------------------------------------------------------------------*/
+enum Type {
+  TYPE_CHAR,
+  TYPE_SHORT,
+  TYPE_INT,
+  TYPE_LONG,
+  TYPE_FLOAT,
+  TYPE_DOUBLE,
+  TYPE_STRING,
+#if HAVE_POINT
+  TYPE_POINT,
+#endif
+#if HAVE_BCN
+  TYPE_BCN,
+#endif
+#if HAVE_NORDFLOAT
+  TYPE_NORDFLOAT,
+#endif
+  TYPE_DATE
+};
+
+enum Style {
+  STYLE_DEFAULT,
+  STYLE_BINARY,
+  STYLE_OCTAL,
+  STYLE_DECIMAL,
+  STYLE_HEX
+};
+
+enum Quoting {
+  QUOTING_NONE,
+  QUOTING_SHELL,
+  QUOTING_TCL
+};
+
+/*--- Binary representation of a date, all since epoch */
+enum Epoch {
+  EPOCH_SECONDS,			/* time_t */
+  EPOCH_MILLI,				/* int64_t */
+  EPOCH_MICRO,
+  EPOCH_NANO,
+  EPOCH_DOUBLE				/* double seconds */
+};
+
+typedef struct {
+  enum Type type;
+  enum Style style;
+  enum Quoting quoting;
+  int unsignedp;			/* Also UTC for date */
+  int byteswap;
+  int raw;				/* Binary data of given type */
+  int width;				/* Minimum digits, zero-padded */
+  int precision;			/* Significant digits, 0 for %g */
+  enum Epoch epoch;			/* Units of date */
+  int wrap;				/* From raw: keep low bits of ints */
+  int truncate;				/* From raw: floats toward zero */
+} Conversion;
+
+#define PRECISION_SHORTEST (-1)		/* As many as needed to read back */
+#define FORMAT_MAXWIDTH 64		/* Most digits for width */
+
+/*--- Defaults: integer, default style, signed, text */
+Conversion *conversion_create(void);
+void conversion_free(Conversion *conv);
+
+/*-----------------------------------------------------------------------
+ *	Running a conversion
+ *	Raw input is of inconv's type, converted to outconv's when both are
+ *	numeric and differ in more than signedness, else passed on as it
+ *	is.  Text input is one value per line (or argument), or with
+ *	split set many per line, separated by spaces, tabs or commas; an
+ *	empty field between commas, as in "5,,6", is an error.  Text output
+ *	has sep between values, or a newline after every perline values,
+ *	and ends with a newline.  With aggregate set, the values are
+ *	summarised instead, written as if values of name, tab and value for
+ *	each of count, nan (floats only), min, max, sum, mean and stddev;
+ *	with nbin set too, then "below", "bin<tab>from<tab>to<tab>count"
+ *	per bin and "above".
+ *	With decimate or points set, values come in buckets instead, each
+ *	written as its minimum, maximum and perhaps mean, of the output
+ *	type; text has a line per bucket unless sep or perline is given.
+ *-----------------------------------------------------------------------*/
+/*--- Counts and times per stage, on stderr when done */
+enum StatsFormat {
+  STATS_NONE,
+  STATS_TEXT,				/* Table */
+  STATS_JSON				/* One JSON object */
+};
+
+typedef struct {
+  const char *infile;			/* File to read, "-" for stdin... */
+  int argc;				/* ...or else these strings */
+  char **argv;
+  const char *sep;			/* NULL: newline, space if perline */
+  int perline;				/* Values per output line, or 0 */
+  int split;				/* Many values per input line */
+  int njob;				/* Threads for a raw file */
+  const char *record;			/* Record layout, e.g. "<ihhhd" */
+  long skip;				/* Bytes of input to pass over */
+  int first;				/* Then from value first, */
+  int stride;				/* every stride-th (0: each) */
+  long count;				/* up to count values (0: all) */
+  int nchannel;				/* If set, value i becomes */
+  const double *scale;			/* x * scale[i % nchannel] */
+  const double *offset;			/* + offset[i % nchannel]; */
+					/* NULL for 1 or 0 */
+  long decimate;			/* Buckets of decimate values, */
+  long points;				/* or at most points buckets of */
+					/* raw input, become min, max */
+  int mean;				/* and if set mean */
+  int aggregate;			/* Summary text instead of values */
+  int nbin;				/* With histogram of nbin bins */
+  double lo, hi;			/* over [lo, hi) */
+  enum StatsFormat stats;		/* cconv_run only */
+} CconvOptions;
+
+void cconv_options_init(CconvOptions *opt);
+
+/*--- Convert to stdout as the cconv command does; returns 0 */
+int cconv_run(Conversion *in, Conversion *out, const CconvOptions *opt);
+
+/*--- Convert srclen bytes at src into at most dstsize bytes at dst;
+ * returns the number of bytes written, or -1 if dst was too small.
+ * Of opt (which may be NULL) infile, argc, argv, njob and stats are
+ * ignored.
+ * Safe to call from several threads at once. */
+long cconv_convert(const char *src, long srclen, Conversion *in,
+		   char *dst, long dstsize, Conversion *out,
+		   const CconvOptions *opt);
+
+/*--- Date/time text, as accepted by -Y, to seconds and nanoseconds
+ * since epoch; times without a zone are local, or UTC if utc is set.
+ * Returns 0 if not recognised. */
+int text2date(const char *str, const char *end, time_t *p_time,
+	      long *p_nsec, int utc);
+
+/*-----------------------------------------------------------------------
+ *	Errors
+ *	Messages are prefixed by cconv_progname.  Bad input that cannot be
+ *	converted calls cconv_fail with the message if set, which must not
+ *	return (e.g. it may longjmp); otherwise the message is printed on
+ *	stderr and the process exits.  Memory of a call abandoned by longjmp
+ *	is reclaimed by the next call in the same thread.
+ *-----------------------------------------------------------------------*/
+extern const char *cconv_progname;
+extern void (*cconv_fail)(const char *msg);
+
+#endif